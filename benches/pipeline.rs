@@ -0,0 +1,125 @@
+// benchmarks for the lex, parse and interpret phases plus the brainrot
+// preprocessor, over the checked-in corpus in code/ and a few synthetic
+// stress programs. run with `cargo bench`.
+use tidal::{brainrot, compiler, lexer, optimizer, parser, vm};
+
+use criterion::{black_box, criterion_group, criterion_main, Criterion};
+use std::fs;
+
+// the .td files directly in code/Normal/ (the Examples subdirectory holds
+// deliberately infinite demos, so it only feeds the lex and parse benches)
+fn corpus(dir: &str, extension: &str) -> Vec<(String, String)> {
+    let mut files: Vec<(String, String)> = fs::read_dir(dir)
+        .expect("corpus directory missing")
+        .filter_map(|entry| {
+            let path = entry.ok()?.path();
+            if path.extension()? == extension {
+                let name = path.file_stem()?.to_string_lossy().into_owned();
+                let source = fs::read_to_string(&path).ok()?;
+                Some((name, source))
+            } else {
+                None
+            }
+        })
+        .collect();
+    files.sort();
+    files
+}
+
+// synthetic stress programs: hot numeric loop, heavy string concat, and one
+// machine-generated deep expression chain
+fn synthetic() -> Vec<(String, String)> {
+    let mut numeric_loop = String::from("var i = 0;\nvar acc = 0;\n");
+    numeric_loop.push_str("while (i < 20000) {\n    acc = acc + i;\n    i = i + 1;\n}\n");
+
+    let mut string_concat = String::from("var s = \"\";\nvar i = 0;\n");
+    string_concat.push_str("while (i < 2000) {\n    s = s + \"line \" + str(i);\n    i = i + 1;\n}\n");
+
+    let mut deep_expr = String::from("var total = 0");
+    for term in 0..2000 {
+        deep_expr.push_str(&format!(" + {}", term % 10));
+    }
+    deep_expr.push_str(";\n");
+
+    vec![
+        ("numeric_loop".to_string(), numeric_loop),
+        ("string_concat".to_string(), string_concat),
+        ("deep_expr".to_string(), deep_expr),
+    ]
+}
+
+fn lex_source(source: &str) -> usize {
+    let mut lexer = lexer::Lexer::new(source);
+    let mut count = 0;
+    while lexer.next_token() != lexer::Token::EOF {
+        count += 1;
+    }
+    count
+}
+
+fn bench_lex(c: &mut Criterion) {
+    let mut group = c.benchmark_group("lex");
+    let mut inputs = corpus("code/Normal", "td");
+    inputs.extend(corpus("code/Normal/Examples", "td"));
+    inputs.extend(synthetic());
+    for (name, source) in inputs {
+        group.bench_function(&name, |b| b.iter(|| lex_source(black_box(&source))));
+    }
+    group.finish();
+}
+
+fn bench_parse(c: &mut Criterion) {
+    let mut group = c.benchmark_group("parse");
+    let mut inputs = corpus("code/Normal", "td");
+    inputs.extend(corpus("code/Normal/Examples", "td"));
+    inputs.extend(synthetic());
+    // some corpus files are deliberate error demos that panic in the parser
+    let previous_hook = std::panic::take_hook();
+    std::panic::set_hook(Box::new(|_| {}));
+    inputs.retain(|(_, source)| {
+        let source = source.clone();
+        std::panic::catch_unwind(move || parser::Parser::new(&source).parse()).is_ok()
+    });
+    std::panic::set_hook(previous_hook);
+    for (name, source) in inputs {
+        group.bench_function(&name, |b| {
+            b.iter(|| parser::Parser::new(black_box(&source)).parse())
+        });
+    }
+    group.finish();
+}
+
+fn bench_interpret(c: &mut Criterion) {
+    let mut group = c.benchmark_group("interpret");
+    group.sample_size(20);
+    for (name, source) in synthetic() {
+        let mut parser = parser::Parser::new(&source);
+        let program = optimizer::optimize(parser.parse());
+        let chunk = compiler::compile(&program, parser.slots());
+        group.bench_function(&name, |b| {
+            b.iter(|| {
+                vm::run_with_frame(
+                    black_box(&chunk),
+                    &mut Vec::new(),
+                    &mut std::io::sink(),
+                    false,
+                    None,
+                )
+            })
+        });
+    }
+    group.finish();
+}
+
+fn bench_preprocess(c: &mut Criterion) {
+    let mut group = c.benchmark_group("preprocess");
+    for (name, source) in corpus("code/BrainRot", "br") {
+        group.bench_function(&name, |b| {
+            b.iter(|| brainrot::preprocess_skibidi(black_box(&source)))
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(benches, bench_lex, bench_parse, bench_interpret, bench_preprocess);
+criterion_main!(benches);
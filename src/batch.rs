@@ -0,0 +1,151 @@
+use crate::{brainrot, cache, compiler, error, modules, optimizer, parser, vm};
+use std::fs;
+use std::io::{self, Write};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::time::{Duration, Instant};
+
+// batch mode: run a whole suite of scripts inside one process instead of
+// paying process spawn and startup once per file. the target is either a
+// directory (every .td/.br under it, sorted) or a list file with one script
+// path per line. each script gets a fresh frame - scripts are independent -
+// but the process, allocator and warmed code are shared. with --jobs N the
+// files are spread over N threads; every file's output is captured into its
+// own buffer, so stdout still comes out whole and in input order.
+pub fn run(target: &str, jobs: usize, is_verbose: bool, no_opt: bool) {
+    let files = collect_files(target);
+    if files.is_empty() {
+        eprintln!("Error: No .td or .br files found in '{}'", target);
+        std::process::exit(1);
+    }
+
+    let started = Instant::now();
+    let results: Vec<Mutex<Option<FileResult>>> =
+        files.iter().map(|_| Mutex::new(None)).collect();
+    let next = AtomicUsize::new(0);
+
+    let worker = || loop {
+        let i = next.fetch_add(1, Ordering::Relaxed);
+        if i >= files.len() {
+            break;
+        }
+        let result = run_file(&files[i], is_verbose, no_opt);
+        *results[i].lock().unwrap() = Some(result);
+    };
+
+    if jobs > 1 {
+        std::thread::scope(|scope| {
+            for _ in 0..jobs.min(files.len()) {
+                scope.spawn(worker);
+            }
+        });
+    } else {
+        worker();
+    }
+
+    let mut out = io::BufWriter::new(io::stdout().lock());
+    let mut failed = 0;
+    for (file, slot) in files.iter().zip(&results) {
+        let result = slot.lock().unwrap().take().unwrap();
+        out.write_all(&result.output)
+            .expect("Something went wrong writing output");
+        let millis = result.elapsed.as_secs_f64() * 1000.0;
+        match result.error {
+            None => eprintln!("ok     {} ({:.1}ms)", file.display(), millis),
+            Some(message) => {
+                failed += 1;
+                eprintln!("error  {} ({:.1}ms): {}", file.display(), millis, message);
+            }
+        }
+    }
+    out.flush().expect("Something went wrong writing output");
+    eprintln!(
+        "batch: {} files, {} ok, {} failed in {:.1}ms",
+        files.len(),
+        files.len() - failed,
+        failed,
+        started.elapsed().as_secs_f64() * 1000.0
+    );
+    if failed > 0 {
+        std::process::exit(1);
+    }
+}
+
+struct FileResult {
+    output: Vec<u8>,
+    error: Option<String>,
+    elapsed: Duration,
+}
+
+// one script, front to back: read, preprocess, cache check, parse, compile,
+// run. the pipeline unwinds on errors, so it runs guarded and an error becomes
+// this file's status line instead of taking the whole batch down.
+fn run_file(path: &Path, is_verbose: bool, no_opt: bool) -> FileResult {
+    let started = Instant::now();
+    let mut output = Vec::new();
+    let outcome = error::catch(|| {
+        let contents = fs::read_to_string(path)
+            .expect("Something went wrong reading the file");
+        let processed_contents = if path.extension().is_some_and(|e| e == "br") {
+            brainrot::preprocess_skibidi(&contents)
+        } else {
+            contents
+        };
+        let processed_contents =
+            modules::resolve(&path.to_string_lossy(), processed_contents);
+
+        let hash = cache::source_hash(&processed_contents);
+        let tdc = cache::cache_path(&path.to_string_lossy());
+        let chunk = match cache::load(&tdc, hash) {
+            Some(chunk) => chunk,
+            None => {
+                let mut parser = parser::Parser::new(&processed_contents);
+                let program = parser.parse();
+                let program = if no_opt { program } else { optimizer::optimize(program) };
+                compiler::compile(&program, parser.slots())
+            }
+        };
+        vm::run_with_frame(&chunk, &mut Vec::new(), &mut output, is_verbose, None);
+    });
+
+    FileResult {
+        output,
+        error: outcome.err().map(|e| e.to_string()),
+        elapsed: started.elapsed(),
+    }
+}
+
+fn collect_files(target: &str) -> Vec<PathBuf> {
+    let path = Path::new(target);
+    if path.is_dir() {
+        let mut files = Vec::new();
+        walk(path, &mut files);
+        files.sort();
+        files
+    } else {
+        // a list file: one script path per line, blanks and # comments skipped
+        let listing = fs::read_to_string(path).unwrap_or_else(|e| {
+            eprintln!("Error: Could not read '{}': {}", target, e);
+            std::process::exit(1);
+        });
+        listing
+            .lines()
+            .map(str::trim)
+            .filter(|line| !line.is_empty() && !line.starts_with('#'))
+            .map(PathBuf::from)
+            .collect()
+    }
+}
+
+fn walk(dir: &Path, files: &mut Vec<PathBuf>) {
+    let Ok(entries) = fs::read_dir(dir) else { return };
+    for entry in entries.flatten() {
+        let path = entry.path();
+        if path.is_dir() {
+            walk(&path, files);
+        } else if path.extension().is_some_and(|e| e == "td" || e == "br") {
+            files.push(path);
+        }
+    }
+}
@@ -0,0 +1,89 @@
+//okay, here is where the brainrot starts ☠️☠️
+//
+// one streaming pass over the input bytes through a small aho-corasick
+// automaton built from the replacement table, writing into a pre-sized output
+// buffer. the old version re-collected every key into a Vec<char> at every
+// input position, which made preprocessing O(input x keys) with constant
+// allocator churn and slower than actually running the script.
+const REPLACEMENTS: [(&str, &str); 14] = [
+    ("rizzler", "var"),
+    ("sigma", "novar"),
+    /* ("be", "="), */
+    ("no cap", ";"),
+    ("skibidi", "print"),
+    ("fanum tax", "type"),
+    ("bussin", "for"),
+    ("yeet", "while"),
+    ("sussy", "/*"),
+    ("baka", "*/"),
+    ("aura +69420", "break"),
+    ("aura -69420", "continue"),
+    ("drip", "if"),
+    ("mid", "elif"),
+    ("nah", "else"),
+];
+
+pub fn preprocess_skibidi(input: &str) -> String {
+    // trie over the pattern bytes; node 0 is the root and edge value 0 means
+    // "no edge", which is unambiguous because nothing ever points back at root
+    let mut children: Vec<[u32; 256]> = vec![[0; 256]];
+    let mut out: Vec<Option<(usize, &str)>> = vec![None];
+    for &(pattern, replacement) in &REPLACEMENTS {
+        let mut node = 0;
+        for &byte in pattern.as_bytes() {
+            let child = children[node][byte as usize];
+            node = if child == 0 {
+                children.push([0; 256]);
+                out.push(None);
+                let child = children.len() - 1;
+                children[node][byte as usize] = child as u32;
+                child
+            } else {
+                child as usize
+            };
+        }
+        out[node] = Some((pattern.len(), replacement));
+    }
+
+    // resolve failure transitions breadth-first into a dense next table, so
+    // the scan below is exactly one table lookup per input byte. no pattern
+    // is a suffix of another, so there are no output sets to merge.
+    let mut next = children.clone();
+    let mut fail = vec![0u32; next.len()];
+    let mut queue: std::collections::VecDeque<usize> = (0..256)
+        .filter_map(|byte| match children[0][byte] {
+            0 => None,
+            child => Some(child as usize),
+        })
+        .collect();
+    while let Some(node) = queue.pop_front() {
+        for byte in 0..256 {
+            let child = children[node][byte];
+            if child == 0 {
+                next[node][byte] = next[fail[node] as usize][byte];
+            } else {
+                fail[child as usize] = next[fail[node] as usize][byte];
+                queue.push_back(child as usize);
+            }
+        }
+    }
+
+    let bytes = input.as_bytes();
+    let mut result = String::with_capacity(input.len());
+    let mut state = 0;
+    let mut copied = 0;
+    for (i, &byte) in bytes.iter().enumerate() {
+        state = next[state][byte as usize] as usize;
+        if let Some((length, replacement)) = out[state] {
+            let start = i + 1 - length;
+            result.push_str(&input[copied..start]);
+            result.push_str(replacement);
+            copied = i + 1;
+            // the old scanner jumped straight past a replaced key, so a new
+            // match can only start after it; drop any partial one
+            state = 0;
+        }
+    }
+    result.push_str(&input[copied..]);
+    result
+}
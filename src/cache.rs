@@ -0,0 +1,484 @@
+use crate::compiler::{Chunk, FunctionInfo, Instruction, Operand, ParallelLoop};
+use crate::lexer::Token;
+use crate::parser::{Slot, Value};
+use std::fs;
+use std::rc::Rc;
+
+// compiled bytecode cache (.tdc): a flat little-endian encoding of a Chunk,
+// fronted by a hash of the source it was compiled from. loading is one linear
+// decode pass over the byte buffer - no per-node tree rebuilding - so repeated
+// runs of an unchanged script skip the lexer, parser and optimizer entirely.
+// anything unexpected in the file (stale hash, truncation, old version) just
+// returns None and the caller falls back to a normal parse.
+
+const MAGIC: &[u8; 4] = b"TDC\x01";
+const FORMAT_VERSION: u32 = 9;
+
+// fnv-1a over the source text, used to tie a cache file to its script
+pub fn source_hash(source: &str) -> u64 {
+    let mut hash: u64 = 0xcbf29ce484222325;
+    for &byte in source.as_bytes() {
+        hash ^= byte as u64;
+        hash = hash.wrapping_mul(0x100000001b3);
+    }
+    hash
+}
+
+pub fn cache_path(filename: &str) -> String {
+    match filename.rfind('.') {
+        Some(dot) => format!("{}.tdc", &filename[..dot]),
+        None => format!("{}.tdc", filename),
+    }
+}
+
+pub fn write(path: &str, chunk: &Chunk, hash: u64) -> std::io::Result<()> {
+    let mut out = Vec::new();
+    out.extend_from_slice(MAGIC);
+    put_u32(&mut out, FORMAT_VERSION);
+    put_u64(&mut out, hash);
+    encode_chunk(&mut out, chunk);
+    fs::write(path, out)
+}
+
+// headerless in-memory encoding, used to hand a chunk to another thread:
+// Value holds Rc, so a chunk cannot be sent directly, but its bytes can and
+// the receiver rebuilds a private copy
+pub fn encode(chunk: &Chunk) -> Vec<u8> {
+    let mut out = Vec::new();
+    encode_chunk(&mut out, chunk);
+    out
+}
+
+pub fn decode(data: &[u8]) -> Option<Chunk> {
+    decode_chunk(&mut Reader { data, pos: 0 })
+}
+
+fn encode_chunk(out: &mut Vec<u8>, chunk: &Chunk) {
+    let mut out = out;
+    put_u32(&mut out, chunk.slot_names.len() as u32);
+    for name in &chunk.slot_names {
+        put_str(&mut out, name);
+    }
+
+    put_u32(&mut out, chunk.functions.len() as u32);
+    for function in &chunk.functions {
+        put_str(&mut out, &function.name);
+        put_u32(&mut out, function.arity as u32);
+        // u64 so the usize::MAX start of a never-defined function survives
+        put_u64(&mut out, function.start as u64);
+        put_u32(&mut out, function.local_names.len() as u32);
+        for name in &function.local_names {
+            put_str(&mut out, name);
+        }
+    }
+
+    put_u32(&mut out, chunk.constants.len() as u32);
+    for constant in &chunk.constants {
+        match constant {
+            Value::Number(n) => {
+                out.push(0);
+                put_u64(&mut out, *n as u64);
+            }
+            Value::Float(f) => {
+                out.push(1);
+                put_u64(&mut out, f.to_bits());
+            }
+            Value::String(s) => {
+                out.push(2);
+                put_str(&mut out, s);
+            }
+            Value::Boolean(b) => {
+                out.push(3);
+                out.push(*b as u8);
+            }
+            Value::Null => out.push(4),
+            Value::Type(t) => {
+                out.push(5);
+                put_str(&mut out, t);
+            }
+            // array literals compile to MakeArray, never to constants
+            Value::Array(_) => panic!("Array constants cannot be cached"),
+        }
+    }
+
+    put_u32(&mut out, chunk.code.len() as u32);
+    for instruction in &chunk.code {
+        match instruction {
+            Instruction::Const(idx) => {
+                out.push(0);
+                put_u32(&mut out, *idx as u32);
+            }
+            Instruction::Load(slot) => {
+                out.push(1);
+                put_u32(&mut out, *slot as u32);
+            }
+            Instruction::Store(slot) => {
+                out.push(2);
+                put_u32(&mut out, *slot as u32);
+            }
+            Instruction::Declare(slot, is_mutable) => {
+                out.push(3);
+                put_u32(&mut out, *slot as u32);
+                out.push(*is_mutable as u8);
+            }
+            Instruction::Binary(op) => {
+                out.push(4);
+                out.push(op_to_byte(op));
+            }
+            Instruction::Not => out.push(5),
+            Instruction::Print => out.push(6),
+            Instruction::TypeOf => out.push(7),
+            Instruction::Cast(type_name) => {
+                out.push(8);
+                put_str(&mut out, type_name);
+            }
+            Instruction::Index => out.push(9),
+            Instruction::Pop => out.push(10),
+            Instruction::Jump(target) => {
+                out.push(11);
+                put_u32(&mut out, *target as u32);
+            }
+            Instruction::JumpIfNotTrue(target) => {
+                out.push(12);
+                put_u32(&mut out, *target as u32);
+            }
+            Instruction::JumpIfFalse(target) => {
+                out.push(13);
+                put_u32(&mut out, *target as u32);
+            }
+            Instruction::JumpIfFalsePeek(target) => {
+                out.push(14);
+                put_u32(&mut out, *target as u32);
+            }
+            Instruction::JumpIfTruePeek(target) => {
+                out.push(15);
+                put_u32(&mut out, *target as u32);
+            }
+            Instruction::Call(func) => {
+                out.push(16);
+                put_u32(&mut out, *func as u32);
+            }
+            Instruction::Return => out.push(17),
+            Instruction::Halt => out.push(18),
+            Instruction::LoadLocal(slot) => {
+                out.push(19);
+                put_u32(&mut out, *slot as u32);
+            }
+            Instruction::StoreLocal(slot) => {
+                out.push(20);
+                put_u32(&mut out, *slot as u32);
+            }
+            Instruction::DeclareLocal(slot, is_mutable) => {
+                out.push(21);
+                put_u32(&mut out, *slot as u32);
+                out.push(*is_mutable as u8);
+            }
+            Instruction::MakeArray(count) => {
+                out.push(22);
+                put_u32(&mut out, *count as u32);
+            }
+            Instruction::StoreIndex => out.push(23),
+            Instruction::Len => out.push(24),
+            Instruction::Append => out.push(25),
+            Instruction::Substring => out.push(26),
+            Instruction::Join => out.push(30),
+            Instruction::Pad(left) => {
+                out.push(31);
+                out.push(*left as u8);
+            }
+            Instruction::ReadLine(has_path) => {
+                out.push(32);
+                out.push(*has_path as u8);
+            }
+            Instruction::WriteFile => out.push(33),
+            Instruction::CmpJump(op, slot, operand, target) => {
+                out.push(27);
+                out.push(op_to_byte(op));
+                put_slot(&mut out, slot);
+                put_operand(&mut out, operand);
+                put_u32(&mut out, *target as u32);
+            }
+            Instruction::UpdateSlot(op, slot, operand) => {
+                out.push(28);
+                out.push(op_to_byte(op));
+                put_slot(&mut out, slot);
+                put_operand(&mut out, operand);
+            }
+            Instruction::ParallelFor(loop_) => {
+                out.push(29);
+                out.push(op_to_byte(&loop_.op));
+                out.push(op_to_byte(&loop_.step_op));
+                put_u32(&mut out, loop_.var as u32);
+                put_u32(&mut out, loop_.snapshot.len() as u32);
+                for &slot in &loop_.snapshot {
+                    put_u32(&mut out, slot as u32);
+                }
+                // the body chunk nests recursively; the decoder reads exactly
+                // the fields it wrote, so no length prefix is needed
+                encode_chunk(out, &loop_.body);
+            }
+            // only the vm installs these, in its own copy of the code
+            Instruction::CmpJumpII(..)
+            | Instruction::CmpJumpFF(..)
+            | Instruction::UpdateSlotII(..)
+            | Instruction::UpdateSlotFF(..)
+            | Instruction::BinaryII(..)
+            | Instruction::BinaryFF(..) => {
+                panic!("Runtime-specialized instruction cannot be cached")
+            }
+        }
+    }
+}
+
+// load a cache file if it exists and matches the given source hash
+pub fn load(path: &str, hash: u64) -> Option<Chunk> {
+    let data = fs::read(path).ok()?;
+    let mut r = Reader { data: &data, pos: 0 };
+
+    if r.bytes(4)? != MAGIC {
+        return None;
+    }
+    if r.u32()? != FORMAT_VERSION {
+        return None;
+    }
+    if r.u64()? != hash {
+        return None;
+    }
+    decode_chunk(&mut r)
+}
+
+fn decode_chunk(r: &mut Reader) -> Option<Chunk> {
+    let slot_count = r.u32()? as usize;
+    let mut slot_names = Vec::with_capacity(slot_count);
+    for _ in 0..slot_count {
+        slot_names.push(r.str()?.to_string());
+    }
+
+    let function_count = r.u32()? as usize;
+    let mut functions = Vec::with_capacity(function_count);
+    for _ in 0..function_count {
+        let name = r.str()?.to_string();
+        let arity = r.u32()? as usize;
+        let start = r.u64()? as usize;
+        let local_count = r.u32()? as usize;
+        let mut local_names = Vec::with_capacity(local_count);
+        for _ in 0..local_count {
+            local_names.push(r.str()?.to_string());
+        }
+        functions.push(FunctionInfo { name, arity, start, local_names });
+    }
+
+    let constant_count = r.u32()? as usize;
+    let mut constants = Vec::with_capacity(constant_count);
+    for _ in 0..constant_count {
+        constants.push(match r.u8()? {
+            0 => Value::Number(r.u64()? as i64),
+            1 => Value::Float(f64::from_bits(r.u64()?)),
+            2 => Value::String(Rc::new(r.str()?.to_string())),
+            3 => Value::Boolean(r.u8()? != 0),
+            4 => Value::Null,
+            5 => Value::Type(Rc::new(r.str()?.to_string())),
+            _ => return None,
+        });
+    }
+
+    let code_count = r.u32()? as usize;
+    let mut code = Vec::with_capacity(code_count);
+    for _ in 0..code_count {
+        code.push(match r.u8()? {
+            0 => Instruction::Const(r.u32()? as usize),
+            1 => Instruction::Load(r.u32()? as usize),
+            2 => Instruction::Store(r.u32()? as usize),
+            3 => Instruction::Declare(r.u32()? as usize, r.u8()? != 0),
+            4 => Instruction::Binary(op_from_byte(r.u8()?)?),
+            5 => Instruction::Not,
+            6 => Instruction::Print,
+            7 => Instruction::TypeOf,
+            8 => Instruction::Cast(r.str()?.to_string()),
+            9 => Instruction::Index,
+            10 => Instruction::Pop,
+            11 => Instruction::Jump(r.u32()? as usize),
+            12 => Instruction::JumpIfNotTrue(r.u32()? as usize),
+            13 => Instruction::JumpIfFalse(r.u32()? as usize),
+            14 => Instruction::JumpIfFalsePeek(r.u32()? as usize),
+            15 => Instruction::JumpIfTruePeek(r.u32()? as usize),
+            16 => Instruction::Call(r.u32()? as usize),
+            17 => Instruction::Return,
+            18 => Instruction::Halt,
+            19 => Instruction::LoadLocal(r.u32()? as usize),
+            20 => Instruction::StoreLocal(r.u32()? as usize),
+            21 => Instruction::DeclareLocal(r.u32()? as usize, r.u8()? != 0),
+            22 => Instruction::MakeArray(r.u32()? as usize),
+            23 => Instruction::StoreIndex,
+            24 => Instruction::Len,
+            25 => Instruction::Append,
+            26 => Instruction::Substring,
+            30 => Instruction::Join,
+            31 => Instruction::Pad(r.u8()? != 0),
+            32 => Instruction::ReadLine(r.u8()? != 0),
+            33 => Instruction::WriteFile,
+            27 => {
+                let op = op_from_byte(r.u8()?)?;
+                let slot = read_slot(r)?;
+                let operand = read_operand(r)?;
+                Instruction::CmpJump(op, slot, operand, r.u32()? as usize)
+            }
+            28 => {
+                let op = op_from_byte(r.u8()?)?;
+                let slot = read_slot(r)?;
+                let operand = read_operand(r)?;
+                Instruction::UpdateSlot(op, slot, operand)
+            }
+            29 => {
+                let op = op_from_byte(r.u8()?)?;
+                let step_op = op_from_byte(r.u8()?)?;
+                let var = r.u32()? as usize;
+                let snapshot_count = r.u32()? as usize;
+                let mut snapshot = Vec::with_capacity(snapshot_count);
+                for _ in 0..snapshot_count {
+                    snapshot.push(r.u32()? as usize);
+                }
+                let body = decode_chunk(r)?;
+                Instruction::ParallelFor(Rc::new(ParallelLoop {
+                    var,
+                    op,
+                    step_op,
+                    snapshot,
+                    body,
+                }))
+            }
+            _ => return None,
+        });
+    }
+
+    Some(Chunk { code, constants, slot_names, functions })
+}
+
+fn op_to_byte(op: &Token) -> u8 {
+    match op {
+        Token::Plus => 0,
+        Token::Minus => 1,
+        Token::Multiply => 2,
+        Token::Divide => 3,
+        Token::FloorDivide => 4,
+        Token::Modulus => 5,
+        Token::Power => 6,
+        Token::Equal => 7,
+        Token::NotEqual => 8,
+        Token::Greater => 9,
+        Token::Less => 10,
+        Token::GreaterEqual => 11,
+        Token::LessEqual => 12,
+        Token::And => 13,
+        Token::Or => 14,
+        other => panic!("Operator token cannot be cached: {:?}", other),
+    }
+}
+
+fn op_from_byte(byte: u8) -> Option<Token> {
+    Some(match byte {
+        0 => Token::Plus,
+        1 => Token::Minus,
+        2 => Token::Multiply,
+        3 => Token::Divide,
+        4 => Token::FloorDivide,
+        5 => Token::Modulus,
+        6 => Token::Power,
+        7 => Token::Equal,
+        8 => Token::NotEqual,
+        9 => Token::Greater,
+        10 => Token::Less,
+        11 => Token::GreaterEqual,
+        12 => Token::LessEqual,
+        13 => Token::And,
+        14 => Token::Or,
+        _ => return None,
+    })
+}
+
+fn put_slot(out: &mut Vec<u8>, slot: &Slot) {
+    match slot {
+        Slot::Global(s) => {
+            out.push(0);
+            put_u32(out, *s as u32);
+        }
+        Slot::Local(s) => {
+            out.push(1);
+            put_u32(out, *s as u32);
+        }
+    }
+}
+
+fn read_slot(r: &mut Reader) -> Option<Slot> {
+    Some(match r.u8()? {
+        0 => Slot::Global(r.u32()? as usize),
+        1 => Slot::Local(r.u32()? as usize),
+        _ => return None,
+    })
+}
+
+fn put_operand(out: &mut Vec<u8>, operand: &Operand) {
+    match operand {
+        Operand::Slot(slot) => {
+            out.push(0);
+            put_slot(out, slot);
+        }
+        Operand::Const(idx) => {
+            out.push(1);
+            put_u32(out, *idx as u32);
+        }
+    }
+}
+
+fn read_operand(r: &mut Reader) -> Option<Operand> {
+    Some(match r.u8()? {
+        0 => Operand::Slot(read_slot(r)?),
+        1 => Operand::Const(r.u32()? as usize),
+        _ => return None,
+    })
+}
+
+fn put_u32(out: &mut Vec<u8>, value: u32) {
+    out.extend_from_slice(&value.to_le_bytes());
+}
+
+fn put_u64(out: &mut Vec<u8>, value: u64) {
+    out.extend_from_slice(&value.to_le_bytes());
+}
+
+fn put_str(out: &mut Vec<u8>, s: &str) {
+    put_u32(out, s.len() as u32);
+    out.extend_from_slice(s.as_bytes());
+}
+
+struct Reader<'a> {
+    data: &'a [u8],
+    pos: usize,
+}
+
+impl<'a> Reader<'a> {
+    fn bytes(&mut self, count: usize) -> Option<&'a [u8]> {
+        let slice = self.data.get(self.pos..self.pos + count)?;
+        self.pos += count;
+        Some(slice)
+    }
+
+    fn u8(&mut self) -> Option<u8> {
+        let byte = *self.data.get(self.pos)?;
+        self.pos += 1;
+        Some(byte)
+    }
+
+    fn u32(&mut self) -> Option<u32> {
+        Some(u32::from_le_bytes(self.bytes(4)?.try_into().ok()?))
+    }
+
+    fn u64(&mut self) -> Option<u64> {
+        Some(u64::from_le_bytes(self.bytes(8)?.try_into().ok()?))
+    }
+
+    fn str(&mut self) -> Option<&'a str> {
+        let len = self.u32()? as usize;
+        std::str::from_utf8(self.bytes(len)?).ok()
+    }
+}
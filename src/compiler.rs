@@ -0,0 +1,977 @@
+use crate::lexer::Token;
+use crate::parser::{ASTNode, FuncDecl, NodeId, Program, Slot, Value};
+use std::collections::HashSet;
+use std::rc::Rc;
+
+// flat bytecode the vm executes, one instruction per basic operation.
+// jumps are absolute indices into the code vector.
+#[derive(Debug, Clone)]
+pub enum Instruction {
+    Const(usize),
+    Load(usize),
+    Store(usize),
+    Declare(usize, bool),
+    // same operations against the current call frame instead of the globals
+    LoadLocal(usize),
+    StoreLocal(usize),
+    DeclareLocal(usize, bool),
+    Binary(Token),
+    // inline-cached forms of Binary, installed by the vm at sites whose
+    // operands were last seen as two ints (or two floats): the hot path
+    // checks that one pair and runs on the primitives, and a type change
+    // deopts back to the generic cross-product match
+    BinaryII(Token),
+    BinaryFF(Token),
+    Not,
+    Print,
+    TypeOf,
+    Cast(String),
+    Index,
+    // pop a value, an index and an array, and write the value into the slot
+    StoreIndex,
+    // pop n elements into a fresh array
+    MakeArray(usize),
+    Len,
+    Append,
+    Join,
+    // true pads on the left
+    Pad(bool),
+    // true pops a file path off the stack, false reads stdin
+    ReadLine(bool),
+    WriteFile,
+    // pop an end, a start and a string, push the [start, end) slice
+    Substring,
+    Pop,
+    Jump(usize),
+    // jump unless the value on top is exactly Boolean(true) (if/elif conditions)
+    JumpIfNotTrue(usize),
+    // jump only when the value on top is exactly Boolean(false) (loop conditions)
+    JumpIfFalse(usize),
+    // short-circuit jumps: peek at the top of the stack without popping
+    JumpIfFalsePeek(usize),
+    JumpIfTruePeek(usize),
+    // pop the arguments into a fresh call frame and jump into the function
+    Call(usize),
+    // pop the return value, tear down the frame, resume after the call site
+    Return,
+    // end of the top-level code; function bodies live after this
+    Halt,
+    // fused counted-loop instructions, produced by the peephole pass below.
+    // a for-loop header compare-and-exit and the `i = i + 1` update each
+    // become one dispatch instead of four, with no stack traffic
+    CmpJump(Token, Slot, Operand, usize),
+    UpdateSlot(Token, Slot, Operand),
+    // type-specialized forms of the two above, installed by the vm when a
+    // loop crosses the hot threshold and its operands are observed to be all
+    // integers (II) or all floats (FF); the vm deopts them back to the
+    // generic forms if the types change. never produced here, never cached
+    CmpJumpII(Token, Slot, Operand, usize),
+    CmpJumpFF(Token, Slot, Operand, usize),
+    UpdateSlotII(Token, Slot, Operand),
+    UpdateSlotFF(Token, Slot, Operand),
+    // pop a step and a bound, read the (just declared) loop variable, and run
+    // the body once per iteration value across a worker pool; behind an Rc so
+    // the vm's code clone stays cheap
+    ParallelFor(Rc<ParallelLoop>),
+}
+
+// everything the vm needs to run one `parallel for`: the body is compiled as
+// its own standalone chunk (same global slot numbering as the enclosing
+// program), workers give each iteration a private frame holding the loop
+// variable and copies of the outer variables the body reads
+#[derive(Debug, Clone)]
+pub struct ParallelLoop {
+    // global slot of the loop variable
+    pub var: usize,
+    // loop condition comparison and update direction (Plus or Minus)
+    pub op: Token,
+    pub step_op: Token,
+    // outer global slots the body reads; snapshotted into every iteration
+    pub snapshot: Vec<usize>,
+    pub body: Chunk,
+}
+
+// the second input of a fused instruction: another variable or a constant
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum Operand {
+    Slot(Slot),
+    Const(usize),
+}
+
+// a compiled function: bodies are appended to the same code vector after the
+// top-level Halt, so a Call is just a frame push and an absolute jump
+#[derive(Debug, Clone)]
+pub struct FunctionInfo {
+    pub name: String,
+    pub arity: usize,
+    pub start: usize,
+    // local slot index -> name, for the frame size and error messages
+    pub local_names: Vec<String>,
+}
+
+#[derive(Debug, Clone)]
+pub struct Chunk {
+    pub code: Vec<Instruction>,
+    pub constants: Vec<Value>,
+    // slot index -> variable name, for the frame size and error messages
+    pub slot_names: Vec<String>,
+    pub functions: Vec<FunctionInfo>,
+}
+
+struct LoopContext {
+    break_jumps: Vec<usize>,
+    continue_jumps: Vec<usize>,
+}
+
+// one unit of expression-lowering work; see Compiler::compile_expr
+enum ExprTask {
+    // compile this node (pushes the follow-up tasks for its children)
+    Node(NodeId),
+    // children are done: emit the node's own instruction
+    Emit(Instruction),
+    // left side of && / || is done: branch, compile the right side, combine
+    Logic(Token, NodeId),
+    // back-patch the branch recorded at this position
+    Patch(usize),
+}
+
+pub struct Compiler<'a> {
+    nodes: &'a [ASTNode],
+    functions: &'a [FuncDecl],
+    chunk: Chunk,
+    loop_stack: Vec<LoopContext>,
+}
+
+pub fn compile(program: &Program, slot_names: Vec<String>) -> Chunk {
+    let mut compiler = Compiler::new(&program.nodes, &program.functions, slot_names);
+    for &stmt in &program.statements {
+        compiler.compile_statement(stmt);
+    }
+    compiler.emit(Instruction::Halt);
+
+    // function bodies go after the top-level code; Call instructions find
+    // them through the start recorded here, so no jump patching is needed
+    for (func, decl) in program.functions.iter().enumerate() {
+        if !decl.defined {
+            continue;
+        }
+        compiler.chunk.functions[func].start = compiler.here();
+        for &stmt in &decl.body {
+            compiler.compile_statement(stmt);
+        }
+        // falling off the end of a function returns null
+        let idx = compiler.add_constant(Value::Null);
+        compiler.emit(Instruction::Const(idx));
+        compiler.emit(Instruction::Return);
+    }
+    let mut chunk = compiler.chunk;
+    fuse(&mut chunk);
+    chunk
+}
+
+// the writes a `parallel for` body may make, established before any code is
+// emitted: assignments and element writes must hit variables declared inside
+// the body, called functions must not touch globals at all, and break or
+// continue must not cross the iteration boundary. everything the body only
+// reads is collected for the per-iteration snapshot.
+struct ParallelCheck<'a> {
+    nodes: &'a [ASTNode],
+    functions: &'a [FuncDecl],
+    slot_names: &'a [String],
+    // the loop variable, readable but not writable
+    var: usize,
+    // globals declared inside the body, iteration-local by construction
+    declared: HashSet<usize>,
+    // outer globals the body reads
+    reads: HashSet<usize>,
+    // depth of loops nested inside the body, for break/continue
+    loop_depth: usize,
+}
+
+impl<'a> ParallelCheck<'a> {
+    fn check_statement(&mut self, id: NodeId) {
+        match &self.nodes[id] {
+            ASTNode::Var(Slot::Global(slot), initializer, _) => {
+                if let Some(expr) = initializer {
+                    self.check_expr(*expr);
+                }
+                self.declared.insert(*slot);
+            }
+            ASTNode::Assign(Slot::Global(slot), expr) => {
+                self.check_expr(*expr);
+                if *slot == self.var {
+                    panic!(
+                        "parallel for body cannot write the loop variable '{}'",
+                        self.slot_names[*slot]
+                    );
+                }
+                if !self.declared.contains(slot) {
+                    panic!(
+                        "parallel for body writes outer variable '{}'",
+                        self.slot_names[*slot]
+                    );
+                }
+            }
+            ASTNode::IndexAssign(target, index, value) => {
+                self.check_write_root(*target);
+                self.check_expr(*target);
+                self.check_expr(*index);
+                self.check_expr(*value);
+            }
+            ASTNode::Append(array, value) => {
+                self.check_write_root(*array);
+                self.check_expr(*array);
+                self.check_expr(*value);
+            }
+            // file positions are per-run state the iterations would race on
+            ASTNode::Write(..) => panic!("write() is not supported inside parallel for"),
+            ASTNode::Print(expr) | ASTNode::Type(expr) => self.check_expr(*expr),
+            ASTNode::If(condition, if_block, elif_blocks, else_block) => {
+                self.check_expr(*condition);
+                for &stmt in if_block {
+                    self.check_statement(stmt);
+                }
+                for (elif_condition, elif_statements) in elif_blocks {
+                    self.check_expr(*elif_condition);
+                    for &stmt in elif_statements {
+                        self.check_statement(stmt);
+                    }
+                }
+                if let Some(else_statements) = else_block {
+                    for &stmt in else_statements {
+                        self.check_statement(stmt);
+                    }
+                }
+            }
+            ASTNode::While(condition, body) => {
+                self.check_expr(*condition);
+                self.loop_depth += 1;
+                for stmt in body.clone() {
+                    self.check_statement(stmt);
+                }
+                self.loop_depth -= 1;
+            }
+            ASTNode::For(init, condition, update, body) => {
+                let (init, condition, update, body) = (*init, *condition, *update, body.clone());
+                self.check_statement(init);
+                self.check_expr(condition);
+                self.loop_depth += 1;
+                for stmt in body {
+                    self.check_statement(stmt);
+                }
+                self.check_statement(update);
+                self.loop_depth -= 1;
+            }
+            ASTNode::ParallelFor(_) => {
+                panic!("parallel for cannot be nested inside parallel for")
+            }
+            ASTNode::Break | ASTNode::Continue => {
+                if self.loop_depth == 0 {
+                    panic!("break/continue cannot cross parallel for iterations");
+                }
+            }
+            ASTNode::FuncDef => {}
+            ASTNode::Return(_) => {
+                // unreachable: the parser rejects return outside functions and
+                // parallel for inside them
+            }
+            _ => self.check_expr(id),
+        }
+    }
+
+    fn check_expr(&mut self, id: NodeId) {
+        match &self.nodes[id] {
+            ASTNode::Identifier(Slot::Global(slot)) => {
+                if *slot != self.var && !self.declared.contains(slot) {
+                    self.reads.insert(*slot);
+                }
+            }
+            ASTNode::BinaryOp(left, _, right)
+            | ASTNode::Index(left, right)
+            | ASTNode::Join(left, right) => {
+                self.check_expr(*left);
+                self.check_expr(*right);
+            }
+            ASTNode::UnaryOp(_, expr)
+            | ASTNode::Len(expr)
+            | ASTNode::Type(expr)
+            | ASTNode::TypeCast(_, expr) => self.check_expr(*expr),
+            ASTNode::Substring(string, start, end) | ASTNode::Pad(string, start, end, _) => {
+                self.check_expr(*string);
+                self.check_expr(*start);
+                self.check_expr(*end);
+            }
+            ASTNode::ReadLine(_) => panic!("readline() is not supported inside parallel for"),
+            ASTNode::Array(elements) => {
+                for &element in elements.clone().iter() {
+                    self.check_expr(element);
+                }
+            }
+            ASTNode::Call(func, args) => {
+                for &arg in args.clone().iter() {
+                    self.check_expr(arg);
+                }
+                let mut visited = HashSet::new();
+                self.check_function(*func, &mut visited);
+            }
+            _ => {}
+        }
+    }
+
+    // element writes and appends must target an iteration-local array; walk
+    // through index chains to the root variable (a[i][j] = x writes into a)
+    fn check_write_root(&mut self, mut id: NodeId) {
+        while let ASTNode::Index(base, _) = &self.nodes[id] {
+            id = *base;
+        }
+        if let ASTNode::Identifier(Slot::Global(slot)) = &self.nodes[id] {
+            if !self.declared.contains(slot) {
+                panic!(
+                    "parallel for body writes outer variable '{}'",
+                    self.slot_names[*slot]
+                );
+            }
+        }
+    }
+
+    // a called function may only touch its own locals: a global read would
+    // see the snapshot of one arbitrary iteration and a write would race
+    fn check_function(&mut self, func: usize, visited: &mut HashSet<usize>) {
+        if !visited.insert(func) {
+            return;
+        }
+        let decl = &self.functions[func];
+        let mut stack: Vec<NodeId> = decl.body.clone();
+        while let Some(id) = stack.pop() {
+            match &self.nodes[id] {
+                ASTNode::Identifier(Slot::Global(slot))
+                | ASTNode::Assign(Slot::Global(slot), _)
+                | ASTNode::Var(Slot::Global(slot), _, _) => panic!(
+                    "function '{}' called from parallel for accesses global variable '{}'",
+                    decl.name, self.slot_names[*slot]
+                ),
+                ASTNode::Call(callee, args) => {
+                    stack.extend(args.iter().copied());
+                    self.check_function(*callee, visited);
+                }
+                ASTNode::BinaryOp(a, _, b) | ASTNode::Index(a, b) | ASTNode::Join(a, b) => {
+                    stack.extend([*a, *b])
+                }
+                ASTNode::Var(_, Some(expr), _)
+                | ASTNode::Assign(_, expr)
+                | ASTNode::Print(expr)
+                | ASTNode::Type(expr)
+                | ASTNode::UnaryOp(_, expr)
+                | ASTNode::Len(expr)
+                | ASTNode::TypeCast(_, expr)
+                | ASTNode::Return(Some(expr)) => stack.push(*expr),
+                ASTNode::IndexAssign(a, b, c)
+                | ASTNode::Substring(a, b, c)
+                | ASTNode::Pad(a, b, c, _) => stack.extend([*a, *b, *c]),
+                ASTNode::Append(a, b) => stack.extend([*a, *b]),
+                ASTNode::ReadLine(_) | ASTNode::Write(..) => panic!(
+                    "function '{}' called from parallel for uses file I/O",
+                    decl.name
+                ),
+                ASTNode::Array(elements) => stack.extend(elements.iter().copied()),
+                ASTNode::If(condition, if_block, elif_blocks, else_block) => {
+                    stack.push(*condition);
+                    stack.extend(if_block.iter().copied());
+                    for (elif_condition, elif_statements) in elif_blocks {
+                        stack.push(*elif_condition);
+                        stack.extend(elif_statements.iter().copied());
+                    }
+                    if let Some(else_statements) = else_block {
+                        stack.extend(else_statements.iter().copied());
+                    }
+                }
+                ASTNode::While(condition, body) => {
+                    stack.push(*condition);
+                    stack.extend(body.iter().copied());
+                }
+                ASTNode::For(init, condition, update, body) => {
+                    stack.extend([*init, *condition, *update]);
+                    stack.extend(body.iter().copied());
+                }
+                _ => {}
+            }
+        }
+    }
+}
+
+// peephole pass over the finished code: collapse the two four-instruction
+// shapes every counted loop is made of - `load var, load bound, compare,
+// exit-jump` and `load var, operand, arithmetic, store var` - into single
+// CmpJump / UpdateSlot instructions. a window is only fused when no jump
+// lands inside it, and every jump target and function start is remapped to
+// the shifted positions afterwards.
+fn fuse(chunk: &mut Chunk) {
+    let code = std::mem::take(&mut chunk.code);
+    let mut is_target = vec![false; code.len() + 1];
+    for instruction in &code {
+        match instruction {
+            Instruction::Jump(t)
+            | Instruction::JumpIfNotTrue(t)
+            | Instruction::JumpIfFalse(t)
+            | Instruction::JumpIfFalsePeek(t)
+            | Instruction::JumpIfTruePeek(t) => is_target[*t] = true,
+            _ => {}
+        }
+    }
+    for function in &chunk.functions {
+        if function.start != usize::MAX {
+            is_target[function.start] = true;
+        }
+    }
+
+    let mut fused = Vec::with_capacity(code.len());
+    let mut map = vec![0usize; code.len() + 1];
+    let mut pc = 0;
+    while pc < code.len() {
+        map[pc] = fused.len();
+        if pc + 3 < code.len()
+            && !is_target[pc + 1]
+            && !is_target[pc + 2]
+            && !is_target[pc + 3]
+        {
+            if let (Some(slot), Some(operand)) = (load_slot(&code[pc]), operand_of(&code[pc + 1])) {
+                let replacement = match (&code[pc + 2], &code[pc + 3]) {
+                    (Instruction::Binary(op), Instruction::JumpIfFalse(target))
+                        if is_comparison(op) =>
+                    {
+                        Some(Instruction::CmpJump(op.clone(), slot, operand, *target))
+                    }
+                    (Instruction::Binary(op), store)
+                        if is_arithmetic(op) && store_slot(store) == Some(slot) =>
+                    {
+                        Some(Instruction::UpdateSlot(op.clone(), slot, operand))
+                    }
+                    _ => None,
+                };
+                if let Some(instruction) = replacement {
+                    fused.push(instruction);
+                    for covered in pc + 1..pc + 4 {
+                        map[covered] = fused.len() - 1;
+                    }
+                    pc += 4;
+                    continue;
+                }
+            }
+        }
+        fused.push(code[pc].clone());
+        pc += 1;
+    }
+    map[code.len()] = fused.len();
+
+    for instruction in &mut fused {
+        match instruction {
+            Instruction::Jump(t)
+            | Instruction::JumpIfNotTrue(t)
+            | Instruction::JumpIfFalse(t)
+            | Instruction::JumpIfFalsePeek(t)
+            | Instruction::JumpIfTruePeek(t)
+            | Instruction::CmpJump(_, _, _, t) => *t = map[*t],
+            _ => {}
+        }
+    }
+    for function in &mut chunk.functions {
+        if function.start != usize::MAX {
+            function.start = map[function.start];
+        }
+    }
+    chunk.code = fused;
+}
+
+fn load_slot(instruction: &Instruction) -> Option<Slot> {
+    match instruction {
+        Instruction::Load(slot) => Some(Slot::Global(*slot)),
+        Instruction::LoadLocal(slot) => Some(Slot::Local(*slot)),
+        _ => None,
+    }
+}
+
+fn store_slot(instruction: &Instruction) -> Option<Slot> {
+    match instruction {
+        Instruction::Store(slot) => Some(Slot::Global(*slot)),
+        Instruction::StoreLocal(slot) => Some(Slot::Local(*slot)),
+        _ => None,
+    }
+}
+
+fn operand_of(instruction: &Instruction) -> Option<Operand> {
+    match instruction {
+        Instruction::Const(idx) => Some(Operand::Const(*idx)),
+        other => load_slot(other).map(Operand::Slot),
+    }
+}
+
+fn is_comparison(op: &Token) -> bool {
+    matches!(
+        op,
+        Token::Less
+            | Token::LessEqual
+            | Token::Greater
+            | Token::GreaterEqual
+            | Token::Equal
+            | Token::NotEqual
+    )
+}
+
+fn is_arithmetic(op: &Token) -> bool {
+    matches!(
+        op,
+        Token::Plus
+            | Token::Minus
+            | Token::Multiply
+            | Token::Divide
+            | Token::FloorDivide
+            | Token::Modulus
+            | Token::Power
+    )
+}
+
+impl<'a> Compiler<'a> {
+    fn new(nodes: &'a [ASTNode], functions: &'a [FuncDecl], slot_names: Vec<String>) -> Self {
+        Compiler {
+            nodes,
+            functions,
+            chunk: Chunk {
+                code: Vec::new(),
+                constants: Vec::new(),
+                slot_names,
+                functions: functions
+                    .iter()
+                    .map(|decl| FunctionInfo {
+                        name: decl.name.clone(),
+                        arity: decl.params,
+                        // patched when the body is compiled; an undefined
+                        // function can only be reached through a Call, which
+                        // the compiler rejects
+                        start: usize::MAX,
+                        local_names: decl.local_names.clone(),
+                    })
+                    .collect(),
+            },
+            loop_stack: Vec::new(),
+        }
+    }
+
+    fn emit(&mut self, instruction: Instruction) -> usize {
+        self.chunk.code.push(instruction);
+        self.chunk.code.len() - 1
+    }
+
+    fn add_constant(&mut self, value: Value) -> usize {
+        self.chunk.constants.push(value);
+        self.chunk.constants.len() - 1
+    }
+
+    fn here(&self) -> usize {
+        self.chunk.code.len()
+    }
+
+    fn patch_jump(&mut self, at: usize) {
+        let target = self.here();
+        match &mut self.chunk.code[at] {
+            Instruction::Jump(t)
+            | Instruction::JumpIfNotTrue(t)
+            | Instruction::JumpIfFalse(t)
+            | Instruction::JumpIfFalsePeek(t)
+            | Instruction::JumpIfTruePeek(t) => *t = target,
+            other => panic!("Cannot patch non-jump instruction: {:?}", other),
+        }
+    }
+
+    // reject a parallel body that writes anything outside its own iteration,
+    // and return the outer globals it reads (sorted, for the snapshot)
+    fn check_parallel_body(&self, header: &crate::parser::ParallelFor) -> Vec<usize> {
+        let mut check = ParallelCheck {
+            nodes: self.nodes,
+            functions: self.functions,
+            slot_names: &self.chunk.slot_names,
+            var: header.var,
+            declared: HashSet::new(),
+            reads: HashSet::new(),
+            loop_depth: 0,
+        };
+        for &stmt in &header.body {
+            check.check_statement(stmt);
+        }
+        let mut reads: Vec<usize> = check.reads.into_iter().collect();
+        reads.sort_unstable();
+        reads
+    }
+
+    // the body becomes its own chunk with the same global slot numbering, so
+    // a worker can run it against a private frame with no slot remapping.
+    // function bodies are compiled in again since the body may call them
+    fn compile_parallel_body(&self, body: &[NodeId]) -> Chunk {
+        let mut compiler = Compiler::new(self.nodes, self.functions, self.chunk.slot_names.clone());
+        for &stmt in body {
+            compiler.compile_statement(stmt);
+        }
+        compiler.emit(Instruction::Halt);
+        for (func, decl) in self.functions.iter().enumerate() {
+            if !decl.defined {
+                continue;
+            }
+            compiler.chunk.functions[func].start = compiler.here();
+            for &stmt in &decl.body {
+                compiler.compile_statement(stmt);
+            }
+            let idx = compiler.add_constant(Value::Null);
+            compiler.emit(Instruction::Const(idx));
+            compiler.emit(Instruction::Return);
+        }
+        let mut chunk = compiler.chunk;
+        fuse(&mut chunk);
+        chunk
+    }
+
+    fn compile_statement(&mut self, id: NodeId) {
+        match &self.nodes[id] {
+            ASTNode::Var(slot, initializer, is_mutable) => {
+                let (slot, is_mutable) = (*slot, *is_mutable);
+                match initializer {
+                    Some(expr) => self.compile_expr(*expr),
+                    None => {
+                        let idx = self.add_constant(Value::Null);
+                        self.emit(Instruction::Const(idx));
+                    }
+                }
+                match slot {
+                    Slot::Global(slot) => self.emit(Instruction::Declare(slot, is_mutable)),
+                    Slot::Local(slot) => self.emit(Instruction::DeclareLocal(slot, is_mutable)),
+                };
+            }
+            ASTNode::Assign(slot, expr) => {
+                let (slot, expr) = (*slot, *expr);
+                self.compile_expr(expr);
+                match slot {
+                    Slot::Global(slot) => self.emit(Instruction::Store(slot)),
+                    Slot::Local(slot) => self.emit(Instruction::StoreLocal(slot)),
+                };
+            }
+            ASTNode::Print(expr) => {
+                self.compile_expr(*expr);
+                self.emit(Instruction::Print);
+            }
+            ASTNode::Type(expr) => {
+                self.compile_expr(*expr);
+                self.emit(Instruction::TypeOf);
+                self.emit(Instruction::Pop);
+            }
+            ASTNode::IndexAssign(target, index, value) => {
+                let (target, index, value) = (*target, *index, *value);
+                self.compile_expr(target);
+                self.compile_expr(index);
+                self.compile_expr(value);
+                self.emit(Instruction::StoreIndex);
+            }
+            ASTNode::Append(array, value) => {
+                let (array, value) = (*array, *value);
+                self.compile_expr(array);
+                self.compile_expr(value);
+                self.emit(Instruction::Append);
+            }
+            ASTNode::Write(path, value) => {
+                let (path, value) = (*path, *value);
+                self.compile_expr(path);
+                self.compile_expr(value);
+                self.emit(Instruction::WriteFile);
+            }
+            ASTNode::If(condition, if_block, elif_blocks, else_block) => {
+                let (condition, if_block, elif_blocks, else_block) =
+                    (*condition, if_block.clone(), elif_blocks.clone(), else_block.clone());
+                self.compile_expr(condition);
+                let mut next_jump = self.emit(Instruction::JumpIfNotTrue(0));
+                let mut end_jumps = Vec::new();
+
+                for stmt in if_block {
+                    self.compile_statement(stmt);
+                }
+                end_jumps.push(self.emit(Instruction::Jump(0)));
+
+                for (elif_condition, elif_statements) in elif_blocks {
+                    self.patch_jump(next_jump);
+                    self.compile_expr(elif_condition);
+                    next_jump = self.emit(Instruction::JumpIfNotTrue(0));
+                    for stmt in elif_statements {
+                        self.compile_statement(stmt);
+                    }
+                    end_jumps.push(self.emit(Instruction::Jump(0)));
+                }
+
+                self.patch_jump(next_jump);
+                if let Some(else_statements) = else_block {
+                    for stmt in else_statements {
+                        self.compile_statement(stmt);
+                    }
+                }
+                for jump in end_jumps {
+                    self.patch_jump(jump);
+                }
+            }
+            ASTNode::While(condition, body) => {
+                let (condition, body) = (*condition, body.clone());
+                let loop_start = self.here();
+                self.compile_expr(condition);
+                let exit_jump = self.emit(Instruction::JumpIfFalse(0));
+
+                self.loop_stack.push(LoopContext {
+                    break_jumps: Vec::new(),
+                    continue_jumps: Vec::new(),
+                });
+                for stmt in body {
+                    self.compile_statement(stmt);
+                }
+                let context = self.loop_stack.pop().unwrap();
+                for jump in context.continue_jumps {
+                    // continue in a while loop re-checks the condition
+                    match &mut self.chunk.code[jump] {
+                        Instruction::Jump(t) => *t = loop_start,
+                        _ => unreachable!(),
+                    }
+                }
+                self.emit(Instruction::Jump(loop_start));
+                self.patch_jump(exit_jump);
+                for jump in context.break_jumps {
+                    self.patch_jump(jump);
+                }
+            }
+            ASTNode::For(init, condition, update, body) => {
+                let (init, condition, update, body) = (*init, *condition, *update, body.clone());
+                self.compile_statement(init);
+                let loop_start = self.here();
+                self.compile_expr(condition);
+                let exit_jump = self.emit(Instruction::JumpIfFalse(0));
+
+                self.loop_stack.push(LoopContext {
+                    break_jumps: Vec::new(),
+                    continue_jumps: Vec::new(),
+                });
+                for stmt in body {
+                    self.compile_statement(stmt);
+                }
+                let context = self.loop_stack.pop().unwrap();
+                // continue in a for loop runs the update before re-checking
+                for jump in context.continue_jumps {
+                    self.patch_jump(jump);
+                }
+                self.compile_statement(update);
+                self.emit(Instruction::Jump(loop_start));
+                self.patch_jump(exit_jump);
+                for jump in context.break_jumps {
+                    self.patch_jump(jump);
+                }
+            }
+            ASTNode::ParallelFor(header) => {
+                let header = header.clone();
+                let snapshot = self.check_parallel_body(&header);
+                let body = self.compile_parallel_body(&header.body);
+                // declare the loop variable with its start value, exactly like
+                // a sequential for; the vm writes the final value back after
+                // the iterations have run
+                self.compile_expr(header.start);
+                self.emit(Instruction::Declare(header.var, true));
+                self.compile_expr(header.bound);
+                self.compile_expr(header.step);
+                self.emit(Instruction::ParallelFor(Rc::new(ParallelLoop {
+                    var: header.var,
+                    op: header.op,
+                    step_op: header.step_op,
+                    snapshot,
+                    body,
+                })));
+            }
+            ASTNode::Break => {
+                let jump = self.emit(Instruction::Jump(0));
+                match self.loop_stack.last_mut() {
+                    Some(context) => context.break_jumps.push(jump),
+                    None => panic!("Break statement outside of loop"),
+                }
+            }
+            ASTNode::Continue => {
+                let jump = self.emit(Instruction::Jump(0));
+                match self.loop_stack.last_mut() {
+                    Some(context) => context.continue_jumps.push(jump),
+                    None => panic!("Continue statement outside of loop"),
+                }
+            }
+            // the body is compiled separately after the top-level code
+            ASTNode::FuncDef => {}
+            ASTNode::Return(value) => {
+                match value {
+                    Some(expr) => self.compile_expr(*expr),
+                    None => {
+                        let idx = self.add_constant(Value::Null);
+                        self.emit(Instruction::Const(idx));
+                    }
+                }
+                self.emit(Instruction::Return);
+            }
+            // everything else is an expression evaluated for its side effects
+            _ => {
+                self.compile_expr(id);
+                self.emit(Instruction::Pop);
+            }
+        }
+    }
+
+    // expression lowering drives an explicit work stack instead of recursing:
+    // a node pushes its children plus a follow-up task that emits its own
+    // instruction once they are done, so depth is bounded by the heap and
+    // machine-generated chains of thousands of terms compile in one flat
+    // loop. tasks pop in LIFO order, so children are pushed last-first.
+    fn compile_expr(&mut self, id: NodeId) {
+        let mut tasks = vec![ExprTask::Node(id)];
+        while let Some(task) = tasks.pop() {
+            match task {
+                ExprTask::Emit(instruction) => {
+                    self.emit(instruction);
+                }
+                // the left operand of a short-circuit operator has just been
+                // compiled: branch over the right side, then patch the branch
+                // once the right side and the operator are in place
+                ExprTask::Logic(op, right) => {
+                    let short = match op {
+                        Token::And => self.emit(Instruction::JumpIfFalsePeek(0)),
+                        Token::Or => self.emit(Instruction::JumpIfTruePeek(0)),
+                        _ => unreachable!(),
+                    };
+                    tasks.push(ExprTask::Patch(short));
+                    tasks.push(ExprTask::Emit(Instruction::Binary(op)));
+                    tasks.push(ExprTask::Node(right));
+                }
+                ExprTask::Patch(at) => self.patch_jump(at),
+                ExprTask::Node(id) => match &self.nodes[id] {
+                    ASTNode::Number(val) => {
+                        let idx = self.add_constant(Value::Number(*val));
+                        self.emit(Instruction::Const(idx));
+                    }
+                    ASTNode::Float(val) => {
+                        let idx = self.add_constant(Value::Float(*val));
+                        self.emit(Instruction::Const(idx));
+                    }
+                    ASTNode::String(val) => {
+                        let idx = self.add_constant(Value::String(Rc::new(val.clone())));
+                        self.emit(Instruction::Const(idx));
+                    }
+                    ASTNode::Boolean(val) => {
+                        let idx = self.add_constant(Value::Boolean(*val));
+                        self.emit(Instruction::Const(idx));
+                    }
+                    ASTNode::Null => {
+                        let idx = self.add_constant(Value::Null);
+                        self.emit(Instruction::Const(idx));
+                    }
+                    ASTNode::TypeLiteral(type_name) => {
+                        let idx = self.add_constant(Value::Type(Rc::new(type_name.clone())));
+                        self.emit(Instruction::Const(idx));
+                    }
+                    ASTNode::Identifier(slot) => {
+                        match slot {
+                            Slot::Global(slot) => self.emit(Instruction::Load(*slot)),
+                            Slot::Local(slot) => self.emit(Instruction::LoadLocal(*slot)),
+                        };
+                    }
+                    ASTNode::Array(elements) => {
+                        let elements = elements.clone();
+                        tasks.push(ExprTask::Emit(Instruction::MakeArray(elements.len())));
+                        for element in elements.into_iter().rev() {
+                            tasks.push(ExprTask::Node(element));
+                        }
+                    }
+                    ASTNode::Len(expr) => {
+                        tasks.push(ExprTask::Emit(Instruction::Len));
+                        tasks.push(ExprTask::Node(*expr));
+                    }
+                    ASTNode::Substring(string, start, end) => {
+                        let (string, start, end) = (*string, *start, *end);
+                        tasks.push(ExprTask::Emit(Instruction::Substring));
+                        tasks.push(ExprTask::Node(end));
+                        tasks.push(ExprTask::Node(start));
+                        tasks.push(ExprTask::Node(string));
+                    }
+                    ASTNode::Join(array, separator) => {
+                        let (array, separator) = (*array, *separator);
+                        tasks.push(ExprTask::Emit(Instruction::Join));
+                        tasks.push(ExprTask::Node(separator));
+                        tasks.push(ExprTask::Node(array));
+                    }
+                    ASTNode::Pad(string, width, fill, left) => {
+                        let (string, width, fill, left) = (*string, *width, *fill, *left);
+                        tasks.push(ExprTask::Emit(Instruction::Pad(left)));
+                        tasks.push(ExprTask::Node(fill));
+                        tasks.push(ExprTask::Node(width));
+                        tasks.push(ExprTask::Node(string));
+                    }
+                    ASTNode::ReadLine(path) => {
+                        let path = *path;
+                        tasks.push(ExprTask::Emit(Instruction::ReadLine(path.is_some())));
+                        if let Some(path) = path {
+                            tasks.push(ExprTask::Node(path));
+                        }
+                    }
+                    ASTNode::Call(func, args) => {
+                        let (func, args) = (*func, args.clone());
+                        let decl = &self.functions[func];
+                        if !decl.defined {
+                            panic!("Unknown function: {}", decl.name);
+                        }
+                        if args.len() != decl.params {
+                            panic!(
+                                "Function '{}' expects {} arguments, got {}",
+                                decl.name,
+                                decl.params,
+                                args.len()
+                            );
+                        }
+                        tasks.push(ExprTask::Emit(Instruction::Call(func)));
+                        for arg in args.into_iter().rev() {
+                            tasks.push(ExprTask::Node(arg));
+                        }
+                    }
+                    ASTNode::BinaryOp(left, op, right) => match op {
+                        Token::And | Token::Or => {
+                            let (left, op, right) = (*left, op.clone(), *right);
+                            tasks.push(ExprTask::Logic(op, right));
+                            tasks.push(ExprTask::Node(left));
+                        }
+                        _ => {
+                            let (left, op, right) = (*left, op.clone(), *right);
+                            tasks.push(ExprTask::Emit(Instruction::Binary(op)));
+                            tasks.push(ExprTask::Node(right));
+                            tasks.push(ExprTask::Node(left));
+                        }
+                    },
+                    ASTNode::UnaryOp(op, expr) => {
+                        match op {
+                            Token::Not => tasks.push(ExprTask::Emit(Instruction::Not)),
+                            _ => panic!("Unsupported unary operation"),
+                        };
+                        tasks.push(ExprTask::Node(*expr));
+                    }
+                    ASTNode::Index(expr, index) => {
+                        let (expr, index) = (*expr, *index);
+                        tasks.push(ExprTask::Emit(Instruction::Index));
+                        tasks.push(ExprTask::Node(index));
+                        tasks.push(ExprTask::Node(expr));
+                    }
+                    ASTNode::Type(expr) => {
+                        tasks.push(ExprTask::Emit(Instruction::TypeOf));
+                        tasks.push(ExprTask::Node(*expr));
+                    }
+                    ASTNode::TypeCast(type_name, expr) => {
+                        let (type_name, expr) = (type_name.clone(), *expr);
+                        tasks.push(ExprTask::Emit(Instruction::Cast(type_name)));
+                        tasks.push(ExprTask::Node(expr));
+                    }
+                    other => {
+                        panic!("Unexpected statement in expression position: {:?}", other)
+                    }
+                },
+            }
+        }
+    }
+}
@@ -0,0 +1,75 @@
+use std::fmt;
+use std::panic::{catch_unwind, panic_any, AssertUnwindSafe};
+
+// a failure from anywhere in the pipeline: lexing, parsing, compiling or
+// running. the pipeline still unwinds internally - threading a Result
+// through every parser helper and vm dispatch arm would bury the logic in
+// plumbing - but it unwinds carrying this structured payload, and catch()
+// turns the unwind into a plain Result. a host can therefore run untrusted
+// scripts back-to-back in one warm process and just match on the error.
+#[derive(Debug, Clone)]
+pub struct ScriptError {
+    pub message: String,
+    // 1-based line and column in the source, when the failure site has one;
+    // runtime errors report without a position since compiled code carries
+    // no line table
+    pub pos: Option<(usize, usize)>,
+}
+
+impl fmt::Display for ScriptError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self.pos {
+            Some((line, column)) => {
+                write!(f, "{} (line {}, column {})", self.message, line, column)
+            }
+            None => write!(f, "{}", self.message),
+        }
+    }
+}
+
+// abort with a position attached; lexer and parser errors go through here
+pub fn fail(message: String, source: &str, offset: usize) -> ! {
+    panic_any(ScriptError {
+        message,
+        pos: Some(position(source, offset)),
+    })
+}
+
+// 1-based line and column of a byte offset into the source
+pub fn position(source: &str, offset: usize) -> (usize, usize) {
+    let offset = offset.min(source.len());
+    let mut line = 1;
+    let mut column = 1;
+    for &byte in &source.as_bytes()[..offset] {
+        if byte == b'\n' {
+            line += 1;
+            column = 1;
+        } else {
+            column += 1;
+        }
+    }
+    (line, column)
+}
+
+// run a piece of the pipeline and convert any unwind into a ScriptError;
+// plain string panics (runtime errors, internal bugs) come through with
+// their message and no position
+pub fn catch<T>(run: impl FnOnce() -> T) -> Result<T, ScriptError> {
+    catch_unwind(AssertUnwindSafe(run)).map_err(|payload| {
+        if let Some(error) = payload.downcast_ref::<ScriptError>() {
+            error.clone()
+        } else if let Some(message) = payload.downcast_ref::<String>() {
+            ScriptError { message: message.clone(), pos: None }
+        } else if let Some(message) = payload.downcast_ref::<&str>() {
+            ScriptError { message: message.to_string(), pos: None }
+        } else {
+            ScriptError { message: "unknown error".to_string(), pos: None }
+        }
+    })
+}
+
+// keep rust's default panic banner and backtrace hint off stderr; every
+// entry point reports errors itself through catch()
+pub fn silence_panics() {
+    std::panic::set_hook(Box::new(|_| {}));
+}
@@ -1,7 +1,15 @@
-use std::str::Chars;
-use std::iter::Peekable;
+use crate::error;
+use std::collections::HashMap;
 
-#[derive(Debug, PartialEq, Clone)]
+// byte range into the source; text-carrying tokens hold one of these instead
+// of an owned String, so lexing allocates nothing
+#[derive(Debug, PartialEq, Clone, Copy)]
+pub struct Span {
+    pub start: usize,
+    pub end: usize,
+}
+
+#[derive(Debug, PartialEq, Clone, Copy)]
 pub enum Token {
     Var,
     NoVar,
@@ -10,13 +18,14 @@ pub enum Token {
     If,
     Elif,
     Else,
-    Identifier(String),
-    Number(i32),
+    // interned: identifiers with the same text share one id (see Tokens)
+    Identifier(u32),
+    Number(i64),
     Float(f64),
-    String(String),
+    String(Span),
     Boolean(bool),
-    TypeLiteral(String),
-    TypeCast(String),
+    TypeLiteral(Span),
+    TypeCast(Span),
     Plus,
     Minus,
     Multiply,
@@ -36,12 +45,23 @@ pub enum Token {
     LBrace,
     RBrace,
     LBracket,
-    RBracket, 
+    RBracket,
     Null,
     For,
+    Parallel,
     While,
     Break,
     Continue,
+    Func,
+    Return,
+    Len,
+    Append,
+    Substring,
+    Join,
+    LPad,
+    RPad,
+    ReadLine,
+    Write,
     Comma,
     Power,
     And,
@@ -50,137 +70,199 @@ pub enum Token {
     EOF,
 }
 
+// the whole input lexed upfront: one contiguous, EOF-terminated token vector
+// the parser can index for free lookahead, plus the identifier intern table.
+// a name that appears thousands of times is hashed once and compared by id
+// everywhere else, and the scan itself is one tight cache-friendly pass.
+pub struct Tokens<'a> {
+    pub tokens: Vec<Token>,
+    // identifier id -> text
+    pub names: Vec<&'a str>,
+    // byte offset of each token's first character, for error positions
+    pub offsets: Vec<u32>,
+}
+
+pub fn tokenize(input: &str) -> Tokens<'_> {
+    let mut lexer = Lexer::new(input);
+    // identifiers and literals average well above four bytes of source each
+    let mut tokens = Vec::with_capacity(input.len() / 4 + 8);
+    let mut offsets = Vec::with_capacity(tokens.capacity());
+    loop {
+        let token = lexer.next_token();
+        tokens.push(token);
+        offsets.push(lexer.token_start as u32);
+        if token == Token::EOF {
+            break;
+        }
+    }
+    Tokens { tokens, names: lexer.names, offsets }
+}
+
+// scans the input as raw bytes with a cursor instead of a Peekable<Chars>,
+// so whitespace, identifiers and numbers are consumed in tight block loops
+// and string tokens borrow from the source via spans.
 pub struct Lexer<'a> {
-    input: Peekable<Chars<'a>>,
+    src: &'a str,
+    bytes: &'a [u8],
+    pos: usize,
+    // where the most recently returned token started
+    token_start: usize,
+    names: Vec<&'a str>,
+    intern_table: HashMap<&'a str, u32>,
 }
 
 impl<'a> Lexer<'a> {
     pub fn new(input: &'a str) -> Self {
         Lexer {
-            input: input.chars().peekable(),
+            src: input,
+            bytes: input.as_bytes(),
+            pos: 0,
+            token_start: 0,
+            names: Vec::new(),
+            intern_table: HashMap::new(),
         }
     }
 
+    fn peek(&self) -> Option<u8> {
+        self.bytes.get(self.pos).copied()
+    }
+
     pub fn next_token(&mut self) -> Token {
         self.skip_whitespace();
+        self.token_start = self.pos;
 
         if let Some(token) = self.handle_comment() {
             return token;
         }
 
-        match self.input.next() {
-            Some(',') => Token::Comma,
-            Some('/') => {
-                if self.input.peek() == Some(&'/') {
-                    self.input.next(); 
+        let ch = match self.peek() {
+            Some(ch) => ch,
+            None => return Token::EOF,
+        };
+        self.pos += 1;
+
+        match ch {
+            b',' => Token::Comma,
+            b'/' => {
+                if self.peek() == Some(b'/') {
+                    self.pos += 1;
                     Token::FloorDivide
                 } else {
                     Token::Divide
                 }
-            },
-            Some('*') => {
-                if self.input.peek() == Some(&'*') {
-                    self.input.next(); 
+            }
+            b'*' => {
+                if self.peek() == Some(b'*') {
+                    self.pos += 1;
                     Token::Power
                 } else {
                     Token::Multiply
                 }
-            },
-            Some('&') => {
-                if self.input.next_if_eq(&'&').is_some() {
+            }
+            b'&' => {
+                if self.peek() == Some(b'&') {
+                    self.pos += 1;
                     Token::And
                 } else {
-                    panic!("Unexpected character: &")
+                    error::fail("Unexpected character: &".to_string(), self.src, self.pos - 1)
                 }
-            },
-            Some('|') => {
-                if self.input.next_if_eq(&'|').is_some() {
+            }
+            b'|' => {
+                if self.peek() == Some(b'|') {
+                    self.pos += 1;
                     Token::Or
                 } else {
-                    panic!("Unexpected character: |")
+                    error::fail("Unexpected character: |".to_string(), self.src, self.pos - 1)
                 }
-            },
-            Some('!') => {
-                if self.input.next_if_eq(&'=').is_some() {
+            }
+            b'!' => {
+                if self.peek() == Some(b'=') {
+                    self.pos += 1;
                     Token::NotEqual
                 } else {
                     Token::Not
                 }
-            },
-            Some(ch) => match ch {
-                '0'..='9' => self.read_number(ch),
-                '+' => Token::Plus,
-                '-' => Token::Minus,
-                '=' => {
-                    if self.input.next_if_eq(&'=').is_some() {
-                        Token::Equal
-                    } else {
-                        Token::Assign
-                    }
-                },
-                '>' => {
-                    if self.input.next_if_eq(&'=').is_some() {
-                        Token::GreaterEqual
-                    } else {
-                        Token::Greater
-                    }
-                },
-                '<' => {
-                    if self.input.next_if_eq(&'=').is_some() {
-                        Token::LessEqual
-                    } else {
-                        Token::Less
-                    }
-                },
-                ';' => Token::Semicolon,
-                '(' => Token::LParen,
-                ')' => Token::RParen,
-                '{' => Token::LBrace,
-                '}' => Token::RBrace,
-                '[' => Token::LBracket,
-                ']' => Token::RBracket,
-                '%' => Token::Modulus,
-                '"' => self.read_string(),
-                'a'..='z' | 'A'..='Z' | '_' => self.read_identifier_or_keyword(ch),
-                _ => panic!("Unexpected character: {}", ch),
-            },
-            None => Token::EOF,
+            }
+            b'0'..=b'9' => self.read_number(),
+            b'+' => Token::Plus,
+            b'-' => Token::Minus,
+            b'=' => {
+                if self.peek() == Some(b'=') {
+                    self.pos += 1;
+                    Token::Equal
+                } else {
+                    Token::Assign
+                }
+            }
+            b'>' => {
+                if self.peek() == Some(b'=') {
+                    self.pos += 1;
+                    Token::GreaterEqual
+                } else {
+                    Token::Greater
+                }
+            }
+            b'<' => {
+                if self.peek() == Some(b'=') {
+                    self.pos += 1;
+                    Token::LessEqual
+                } else {
+                    Token::Less
+                }
+            }
+            b';' => Token::Semicolon,
+            b'(' => Token::LParen,
+            b')' => Token::RParen,
+            b'{' => Token::LBrace,
+            b'}' => Token::RBrace,
+            b'[' => Token::LBracket,
+            b']' => Token::RBracket,
+            b'%' => Token::Modulus,
+            b'"' => self.read_string(),
+            b'a'..=b'z' | b'A'..=b'Z' | b'_' => self.read_identifier_or_keyword(),
+            _ => {
+                // decode the char for the error message
+                self.pos -= 1;
+                let ch = self.src[self.pos..].chars().next().unwrap();
+                error::fail(format!("Unexpected character: {}", ch), self.src, self.pos)
+            }
         }
     }
 
-    fn read_number(&mut self, first_digit: char) -> Token {
-        let mut number = first_digit.to_string();
+    fn read_number(&mut self) -> Token {
+        // the first digit was already consumed
+        let start = self.pos - 1;
         let mut is_float = false;
-        while let Some(&ch) = self.input.peek() {
-            if ch.is_digit(10) {
-                number.push(ch);
-                self.input.next();
-            } else if ch == '.' && !is_float {
+        while let Some(ch) = self.peek() {
+            if ch.is_ascii_digit() {
+                self.pos += 1;
+            } else if ch == b'.' && !is_float {
                 is_float = true;
-                number.push(ch);
-                self.input.next();
+                self.pos += 1;
             } else {
                 break;
             }
         }
+        let text = &self.src[start..self.pos];
         if is_float {
-            Token::Float(number.parse().unwrap())
+            Token::Float(text.parse().unwrap())
         } else {
-            Token::Number(number.parse().unwrap())
+            Token::Number(text.parse().unwrap())
         }
     }
 
-    fn read_identifier_or_keyword(&mut self, first_char: char) -> Token {
-        let mut identifier = first_char.to_string();
-        while let Some(&ch) = self.input.peek() {
-            if ch.is_alphanumeric() || ch == '_' {
-                identifier.push(ch);
-                self.input.next();
+    fn read_identifier_or_keyword(&mut self) -> Token {
+        // the first char was already consumed
+        let start = self.pos - 1;
+        while let Some(ch) = self.peek() {
+            if ch.is_ascii_alphanumeric() || ch == b'_' {
+                self.pos += 1;
             } else {
                 break;
             }
         }
-        match identifier.as_str() {
+        let span = Span { start, end: self.pos };
+        match &self.src[start..self.pos] {
             "var" => Token::Var,
             "novar" => Token::NoVar,
             "print" => Token::Print,
@@ -192,23 +274,47 @@ impl<'a> Lexer<'a> {
             "true" => Token::Boolean(true),
             "false" => Token::Boolean(false),
             "for" => Token::For,
+            "parallel" => Token::Parallel,
             "while" => Token::While,
             "break" => Token::Break,
             "continue" => Token::Continue,
+            "func" => Token::Func,
+            "return" => Token::Return,
+            "len" => Token::Len,
+            "append" => Token::Append,
+            "substring" => Token::Substring,
+            "join" => Token::Join,
+            "lpad" => Token::LPad,
+            "rpad" => Token::RPad,
+            "readline" => Token::ReadLine,
+            "write" => Token::Write,
             "int" | "str" | "float" | "bool" => {
-                if self.input.peek() == Some(&'(') {
-                    Token::TypeCast(identifier)
+                if self.peek() == Some(b'(') {
+                    Token::TypeCast(span)
                 } else {
-                    Token::TypeLiteral(identifier)
+                    Token::TypeLiteral(span)
                 }
-            },
-            _ => Token::Identifier(identifier),
+            }
+            text => {
+                let sym = match self.intern_table.get(text) {
+                    Some(&sym) => sym,
+                    None => {
+                        let sym = self.names.len() as u32;
+                        self.intern_table.insert(text, sym);
+                        self.names.push(text);
+                        sym
+                    }
+                };
+                Token::Identifier(sym)
+            }
         }
     }
 
     fn handle_comment(&mut self) -> Option<Token> {
-        if self.input.next_if(|&ch| ch == '/').is_some() {
-            if self.input.next_if(|&ch| ch == '*').is_some() {
+        if self.peek() == Some(b'/') {
+            self.pos += 1;
+            if self.peek() == Some(b'*') {
+                self.pos += 1;
                 self.skip_multiline_comment();
                 return Some(self.next_token());
             } else {
@@ -221,42 +327,46 @@ impl<'a> Lexer<'a> {
     fn skip_multiline_comment(&mut self) {
         let mut depth = 1;
         while depth > 0 {
-            match (self.input.next(), self.input.peek()) {
-                (Some('*'), Some(&'/')) => {
-                    self.input.next();
+            match self.peek() {
+                Some(b'*') if self.bytes.get(self.pos + 1) == Some(&b'/') => {
+                    self.pos += 2;
                     depth -= 1;
-                },
-                (Some('/'), Some(&'*')) => {
-                    self.input.next();
+                }
+                Some(b'/') if self.bytes.get(self.pos + 1) == Some(&b'*') => {
+                    self.pos += 2;
                     depth += 1;
-                },
-                (Some(_), _) => {},
-                (None, _) => panic!("Unterminated comment"),
+                }
+                Some(_) => self.pos += 1,
+                None => error::fail("Unterminated comment".to_string(), self.src, self.pos),
             }
         }
     }
 
-
     fn read_string(&mut self) -> Token {
-        let mut string = String::new();
-        while let Some(&ch) = self.input.peek() {
-            if ch == '"' {
-                self.input.next(); 
-                break;
+        let start = self.pos;
+        // scan straight to the closing quote; it's ascii, so the span always
+        // lands on a char boundary no matter what's inside the string
+        match self.bytes[self.pos..].iter().position(|&ch| ch == b'"') {
+            Some(offset) => {
+                let span = Span { start, end: start + offset };
+                self.pos = start + offset + 1;
+                Token::String(span)
+            }
+            None => {
+                let span = Span { start, end: self.bytes.len() };
+                self.pos = self.bytes.len();
+                Token::String(span)
             }
-            string.push(ch);
-            self.input.next();
         }
-        Token::String(string)
     }
 
     fn skip_whitespace(&mut self) {
-        while let Some(&ch) = self.input.peek() {
-            if ch.is_whitespace() {
-                self.input.next();
+        while let Some(ch) = self.peek() {
+            if ch.is_ascii_whitespace() {
+                self.pos += 1;
             } else {
                 break;
             }
         }
     }
-}
\ No newline at end of file
+}
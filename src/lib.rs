@@ -0,0 +1,89 @@
+// the Tidal pipeline as a library, so a host process can embed the language
+// instead of forking the `td` binary per script. the binary and the benches
+// are thin consumers of these modules; the Engine below is the embedding
+// entry point.
+
+pub mod batch;
+pub mod brainrot;
+pub mod cache;
+pub mod compiler;
+pub mod error;
+pub mod interpreter;
+pub mod lexer;
+pub mod modules;
+pub mod optimizer;
+pub mod parser;
+pub mod profiler;
+pub mod repl;
+pub mod vm;
+pub mod watch;
+
+use error::ScriptError;
+use parser::{Parser, SymbolState, Value};
+use std::io::{self, Write};
+
+// a long-lived evaluator: one symbol state and one global frame survive
+// across eval() calls, so variables and functions declared by one source are
+// visible to the next and a host amortizes parser state over thousands of
+// evaluations. errors come back as a Result and leave the pre-eval
+// declarations intact, so one bad script cannot wedge the engine. the
+// pipeline reports errors by unwinding, so hosts that don't want rust's
+// default panic banner on stderr should call error::silence_panics() once
+// at startup (the td binary does).
+pub struct Engine {
+    state: SymbolState,
+    frame: Vec<Option<(Value, bool)>>,
+}
+
+impl Engine {
+    pub fn new() -> Self {
+        Engine {
+            state: SymbolState::default(),
+            frame: Vec::new(),
+        }
+    }
+
+    // evaluate a source snippet against the accumulated state; print output
+    // goes to stdout. returns the value of the last statement, if any.
+    pub fn eval(&mut self, source: &str) -> Result<Option<Value>, ScriptError> {
+        self.eval_to(source, &mut io::stdout().lock())
+    }
+
+    // like eval(), but print output goes to the given writer, so a host can
+    // capture it per evaluation
+    pub fn eval_to(
+        &mut self,
+        source: &str,
+        out: &mut dyn Write,
+    ) -> Result<Option<Value>, ScriptError> {
+        // parse against a copy of the state so a failed snippet rolls back
+        let attempt_state = self.state.clone();
+        let (new_state, program, slot_names) = error::catch(|| {
+            let mut parser = Parser::with_state(source, attempt_state);
+            let program = parser.parse();
+            let program = optimizer::optimize(program);
+            let slot_names = parser.slots();
+            (parser.into_state(), program, slot_names)
+        })?;
+        self.state = new_state;
+
+        let result = error::catch(|| {
+            if program.statements.is_empty() {
+                return None;
+            }
+            let chunk = compiler::compile(&program, slot_names);
+            let value = vm::run_with_frame(&chunk, &mut self.frame, out, false, None);
+            Some(value)
+        });
+        // the arena and function definitions outlive the snippet either way,
+        // like the repl: a runtime error doesn't undeclare what parsed fine
+        self.state.adopt(program);
+        result
+    }
+}
+
+impl Default for Engine {
+    fn default() -> Self {
+        Engine::new()
+    }
+}
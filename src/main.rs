@@ -1,25 +1,63 @@
 use std::env;
 use std::fs;
+use std::io::{self, Write};
 use std::path::Path;
-use std::collections::HashMap;
 
-mod interpreter;
-mod lexer;
-mod parser;
+use tidal::{batch, brainrot, cache, compiler, error, interpreter, modules, optimizer, parser, profiler, repl, vm, watch};
 
 fn main() {
     // collect args
     let args: Vec<String> = env::args().collect();
 
+    // errors surface as one "Error: ..." line, not a panic banner
+    error::silence_panics();
+
     // verbose mode flag check
     let is_verbose = args.contains(&String::from("--verbose")) || args.contains(&String::from("-v"));
 
+    // escape hatch for debugging the optimizer
+    let no_opt = args.contains(&String::from("--no-opt"));
+
+    // emit a .tdc bytecode cache instead of running
+    let compile_only = args.contains(&String::from("--compile"));
+
+    // cheap runtime counters with a hot-spot report at exit
+    let profile = args.contains(&String::from("--profile"));
+
     // error display lul
     if args.len() < 2 || args.contains(&String::from("help")) || args.contains(&String::from("--help")) || args.contains(&String::from("-h")) {
         help();
         std::process::exit(1);
     }
 
+    // batch mode: run every script under a directory (or listed in a file)
+    // in this one process, optionally across a thread pool
+    if let Some(pos) = args.iter().position(|a| a == "--batch") {
+        let Some(target) = args.get(pos + 1) else {
+            eprintln!("Error: --batch requires a directory or list file");
+            std::process::exit(1);
+        };
+        let jobs = match args.iter().position(|a| a == "--jobs" || a == "-j") {
+            Some(pos) => args
+                .get(pos + 1)
+                .and_then(|n| n.parse::<usize>().ok())
+                .filter(|&n| n > 0)
+                .unwrap_or_else(|| {
+                    eprintln!("Error: --jobs requires a positive number");
+                    std::process::exit(1);
+                }),
+            None => 1,
+        };
+        batch::run(target, jobs, is_verbose, no_opt);
+        return;
+    }
+
+    // interactive session
+    if args[1] == "repl" {
+        repl::run(is_verbose, no_opt);
+        return;
+    }
+
     let filename = &args[1];
     let is_brain_rot = filename.ends_with(".br");
 
@@ -34,25 +72,91 @@ fn main() {
         std::process::exit(1);
     }
 
+    // watch mode: stay alive and rerun whenever the file or anything it
+    // imports changes, reusing already-compiled versions by content hash
+    if args.contains(&String::from("--watch")) {
+        watch::run(filename, is_verbose, no_opt);
+        return;
+    }
+
     // read file
     let contents = fs::read_to_string(filename)
         .expect("Something went wrong reading the file");
 
     // Brain Rot Parser
     let processed_contents = if is_brain_rot {
-        preprocess_skibidi(&contents)
+        brainrot::preprocess_skibidi(&contents)
     } else {
         contents
     };
 
-    // Parser
-    let mut parser = parser::Parser::new(&processed_contents);
+    // link any imported modules into one source before hashing, so the
+    // cache check below covers the whole program
+    let resolve = || modules::resolve(filename, processed_contents);
+    let processed_contents = match error::catch(resolve) {
+        Ok(contents) => contents,
+        Err(e) => {
+            eprintln!("Error: {}", e);
+            std::process::exit(1);
+        }
+    };
+
+    // a matching .tdc next to the source lets us skip the whole front end;
+    // the hash check makes an edited source fall through to a normal parse
+    let hash = cache::source_hash(&processed_contents);
+    let tdc = cache::cache_path(filename);
+    if !compile_only {
+        if let Some(chunk) = cache::load(&tdc, hash) {
+            let result = error::catch(|| {
+                let mut out = io::BufWriter::new(io::stdout().lock());
+                let mut profiler = if profile {
+                    Some(profiler::Profiler::new(chunk.code.len()))
+                } else {
+                    None
+                };
+                vm::run_with_frame(&chunk, &mut Vec::new(), &mut out, is_verbose, profiler.as_mut());
+                out.flush().expect("Something went wrong writing output");
+                if let Some(profiler) = profiler {
+                    profiler.report(&chunk);
+                }
+            });
+            if let Err(e) = result {
+                eprintln!("Error: {}", e);
+                std::process::exit(1);
+            }
+            return;
+        }
+    }
+
+    let result = error::catch(|| {
+        // Parser
+        let mut parser = parser::Parser::new(&processed_contents);
+
+        // Parser to AST
+        let program = parser.parse();
 
-    // Parser to AST
-    let ast = parser.parse();
+        // Constant folding / simplification
+        let program = if no_opt { program } else { optimizer::optimize(program) };
 
-    // Interpreter
-    interpreter::interpret(ast, is_verbose);
+        if compile_only {
+            let chunk = compiler::compile(&program, parser.slots());
+            match cache::write(&tdc, &chunk, hash) {
+                Ok(()) => println!("Compiled {} to {}", filename, tdc),
+                Err(e) => {
+                    eprintln!("Error: Could not write '{}': {}", tdc, e);
+                    std::process::exit(1);
+                }
+            }
+            return;
+        }
+
+        // Interpreter
+        interpreter::interpret(program, parser.slots(), is_verbose, profile);
+    });
+    if let Err(e) = result {
+        eprintln!("Error: {}", e);
+        std::process::exit(1);
+    }
 }
 
 fn help() {
@@ -61,77 +165,15 @@ fn help() {
     println!("Made by Pranav Verma - For the Lagoon Project.");
     println!("");
     println!("Usage: td <file.td | file.br> [--verbose | -v]");
+    println!("       td repl");
     println!("Options:");
     println!("  --verbose, -v      Enable verbose output");
+    println!("  --no-opt           Disable the AST optimization pass");
+    println!("  --compile          Write a .tdc bytecode cache next to the source");
+    println!("  --batch <target>   Run every .td/.br under a directory (or listed in a file)");
+    println!("  --jobs, -j <n>     Thread count for --batch (default 1)");
+    println!("  --profile          Print a hot-spot report to stderr at exit");
+    println!("  --watch            Rerun the file whenever it or its imports change");
     println!("  help, --help, -h   Display this help message");
     println!("");
 }
-
-//okay, here is where the brainrot starts ☠️☠️
-fn preprocess_skibidi(input: &str) -> String {
-    let replacements: HashMap<&str, &str> = [
-        ("rizzler", "var"),
-        ("sigma", "novar"),
-        /* ("be", "="), */
-        ("no cap", ";"),
-        ("skibidi", "print"),
-        ("fanum tax", "type"),
-        ("bussin", "for"),
-        ("yeet", "while"),
-        ("sussy", "/*"),
-        ("baka", "*/"),
-        ("aura +69420", "break"),
-        ("aura -69420", "continue"),
-        ("drip", "if"),
-        ("mid", "elif"),
-        ("nah", "else"),
-    ].iter().cloned().collect();
-
-    let mut result = String::new();
-    let mut buffer = String::new();
-
-    let chars: Vec<char> = input.chars().collect();
-    let mut i = 0;
-
-    while i < chars.len() {
-        let mut matched = false;
-
-        for (&key, &value) in &replacements {
-            if chars[i..].starts_with(&key.chars().collect::<Vec<_>>()) {
-                result.push_str(value);
-                i += key.len();
-                matched = true;
-                break;
-            }
-        }
-
-        if !matched {
-            if chars[i].is_alphabetic() || chars[i].is_whitespace() {
-                buffer.push(chars[i]);
-            } else {
-                if !buffer.is_empty() {
-                    let trimmed = buffer.trim();
-                    if let Some(&replacement) = replacements.get(trimmed) {
-                        result.push_str(replacement);
-                    } else {
-                        result.push_str(&buffer);
-                    }
-                    buffer.clear();
-                }
-                result.push(chars[i]);
-            }
-            i += 1;
-        }
-    }
-
-    if !buffer.is_empty() {
-        let trimmed = buffer.trim();
-        if let Some(&replacement) = replacements.get(trimmed) {
-            result.push_str(replacement);
-        } else {
-            result.push_str(&buffer);
-        }
-    }
-
-    result
-}
\ No newline at end of file
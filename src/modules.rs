@@ -0,0 +1,180 @@
+use std::collections::HashMap;
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::thread;
+
+// import resolution: `import "lib.td";` lines at the top of a file pull in
+// other modules, and the whole graph is linked into one source before the
+// parser sees it - the same semantics as the concatenation deployments do by
+// hand, with each module included exactly once, dependencies first. the
+// combined text then flows through the normal pipeline, so the content-hash
+// .tdc cache covers the entire program: editing any imported module changes
+// the hash and triggers a re-parse, an unchanged graph skips the front end
+// completely.
+//
+// imports must come before the first statement of a file (blank lines are
+// fine in between) and paths are resolved relative to the importing file.
+// module files at the same depth of the graph are read in parallel.
+
+// returns the linked source; a file without imports passes through untouched
+pub fn resolve(entry: &str, source: String) -> String {
+    resolve_tracked(entry, source).0
+}
+
+// like resolve(), but also returns the canonical path of every file in the
+// module graph (the entry included), so a caller like watch mode knows which
+// files to monitor. a file without imports reports no paths.
+pub fn resolve_tracked(entry: &str, source: String) -> (String, Vec<PathBuf>) {
+    let imports = prologue(&source);
+    if imports.is_empty() {
+        return (source, Vec::new());
+    }
+    let entry_path = canonical(Path::new(entry), entry);
+
+    // load the module graph breadth-first, reading each new frontier of
+    // files off a worker per file; bodies are preprocessed (.br) and their
+    // own prologues scanned for the next frontier
+    let mut modules: HashMap<PathBuf, (String, Vec<PathBuf>)> = HashMap::new();
+    let entry_imports = resolve_paths(&entry_path, &imports);
+    modules.insert(entry_path.clone(), (strip_prologue(source), entry_imports.clone()));
+
+    let mut frontier: Vec<PathBuf> = entry_imports;
+    while !frontier.is_empty() {
+        frontier.retain(|path| !modules.contains_key(path));
+        frontier.dedup();
+        if frontier.is_empty() {
+            break;
+        }
+        let next = AtomicUsize::new(0);
+        let loaded: Vec<Mutex<Option<String>>> =
+            frontier.iter().map(|_| Mutex::new(None)).collect();
+        thread::scope(|scope| {
+            for _ in 0..frontier.len().min(8) {
+                scope.spawn(|| loop {
+                    let index = next.fetch_add(1, Ordering::Relaxed);
+                    if index >= frontier.len() {
+                        break;
+                    }
+                    let path = &frontier[index];
+                    let contents = match fs::read_to_string(path) {
+                        Ok(contents) => contents,
+                        Err(_) => panic!("Cannot import '{}': file not found", path.display()),
+                    };
+                    let contents = if path.extension().is_some_and(|e| e == "br") {
+                        crate::brainrot::preprocess_skibidi(&contents)
+                    } else {
+                        contents
+                    };
+                    *loaded[index].lock().unwrap() = Some(contents);
+                });
+            }
+        });
+
+        let mut next_frontier = Vec::new();
+        for (path, contents) in frontier.iter().zip(loaded) {
+            let contents = contents.into_inner().unwrap().unwrap();
+            let imports = resolve_paths(path, &prologue(&contents));
+            next_frontier.extend(imports.iter().cloned());
+            modules.insert(path.clone(), (strip_prologue(contents), imports));
+        }
+        frontier = next_frontier;
+    }
+
+    // link depth-first from the entry, dependencies before importers, each
+    // module once; a module still on the visit stack means a cycle
+    let mut linked = String::new();
+    let mut done: Vec<PathBuf> = Vec::new();
+    let mut visiting: Vec<PathBuf> = Vec::new();
+    link(&entry_path, &modules, &mut linked, &mut done, &mut visiting);
+    (linked, done)
+}
+
+fn link(
+    path: &PathBuf,
+    modules: &HashMap<PathBuf, (String, Vec<PathBuf>)>,
+    linked: &mut String,
+    done: &mut Vec<PathBuf>,
+    visiting: &mut Vec<PathBuf>,
+) {
+    if done.contains(path) {
+        return;
+    }
+    if visiting.contains(path) {
+        panic!("Import cycle involving '{}'", path.display());
+    }
+    visiting.push(path.clone());
+    let (body, imports) = &modules[path];
+    for import in imports {
+        link(import, modules, linked, done, visiting);
+    }
+    visiting.pop();
+    done.push(path.clone());
+    linked.push_str(body);
+    if !linked.ends_with('\n') {
+        linked.push('\n');
+    }
+}
+
+// the import lines at the top of a file; scanning stops at the first line
+// that is neither blank nor an import, so the rest of the file never needs
+// to be understood here
+fn prologue(source: &str) -> Vec<String> {
+    let mut imports = Vec::new();
+    for line in source.lines() {
+        let line = line.trim();
+        if line.is_empty() {
+            continue;
+        }
+        match import_target(line) {
+            Some(target) => imports.push(target.to_string()),
+            None => break,
+        }
+    }
+    imports
+}
+
+// the body of a file with its import prologue blanked out, keeping the line
+// structure intact
+fn strip_prologue(source: String) -> String {
+    let mut body = String::with_capacity(source.len());
+    let mut in_prologue = true;
+    for line in source.lines() {
+        let trimmed = line.trim();
+        if in_prologue && (trimmed.is_empty() || import_target(trimmed).is_some()) {
+            body.push('\n');
+            continue;
+        }
+        in_prologue = false;
+        body.push_str(line);
+        body.push('\n');
+    }
+    body
+}
+
+// `import "some/path.td";` -> the path between the quotes
+fn import_target(line: &str) -> Option<&str> {
+    let rest = line.strip_prefix("import")?.trim_start();
+    let rest = rest.strip_prefix('"')?;
+    let (target, rest) = rest.split_once('"')?;
+    if rest.trim() != ";" {
+        return None;
+    }
+    Some(target)
+}
+
+fn resolve_paths(importer: &Path, imports: &[String]) -> Vec<PathBuf> {
+    let dir = importer.parent().unwrap_or(Path::new("."));
+    imports
+        .iter()
+        .map(|import| canonical(&dir.join(import), import))
+        .collect()
+}
+
+fn canonical(path: &Path, shown: &str) -> PathBuf {
+    match path.canonicalize() {
+        Ok(path) => path,
+        Err(_) => panic!("Cannot import '{}': file not found", shown),
+    }
+}
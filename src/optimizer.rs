@@ -0,0 +1,405 @@
+use crate::lexer::Token;
+use crate::parser::{ASTNode, NodeId, Program, Value};
+use std::rc::Rc;
+
+// ast simplification pass that runs between Parser::parse and the compiler.
+// constant BinaryOp/UnaryOp/TypeCast subtrees are folded into literal nodes and
+// if/while/for statements with constant conditions are pruned, so expressions
+// like 3600 * 24 * 7 cost nothing when they are reached inside loops.
+//
+// folding rewrites nodes in place in the arena (a folded subtree just leaves
+// its child nodes behind as garbage; the arena is dropped after compilation).
+//
+// folding is deliberately conservative: anything that could panic at runtime
+// (integer overflow, floor division by zero, a failing string parse) is left
+// alone so the error still happens where and when it used to.
+pub fn optimize(program: Program) -> Program {
+    let mut nodes = program.nodes;
+    let statements = optimize_block(program.statements, &mut nodes);
+    let mut functions = program.functions;
+    for decl in &mut functions {
+        let body = std::mem::take(&mut decl.body);
+        decl.body = optimize_block(body, &mut nodes);
+    }
+    Program { nodes, statements, functions }
+}
+
+fn optimize_block(statements: Vec<NodeId>, nodes: &mut Vec<ASTNode>) -> Vec<NodeId> {
+    let mut out = Vec::with_capacity(statements.len());
+    for stmt in statements {
+        out.extend(optimize_statement(stmt, nodes));
+    }
+    out
+}
+
+// a statement can simplify to zero, one, or several statements (a pruned if
+// branch inlines its block), so this returns a list.
+fn optimize_statement(id: NodeId, nodes: &mut Vec<ASTNode>) -> Vec<NodeId> {
+    let node = std::mem::replace(&mut nodes[id], ASTNode::Null);
+    match node {
+        ASTNode::Var(slot, initializer, is_mutable) => {
+            let initializer = initializer.map(|expr| optimize_expr(expr, nodes));
+            nodes[id] = ASTNode::Var(slot, initializer, is_mutable);
+            vec![id]
+        }
+        ASTNode::Assign(slot, expr) => {
+            let expr = optimize_expr(expr, nodes);
+            nodes[id] = ASTNode::Assign(slot, expr);
+            vec![id]
+        }
+        ASTNode::Print(expr) => {
+            let expr = optimize_expr(expr, nodes);
+            nodes[id] = ASTNode::Print(expr);
+            vec![id]
+        }
+        ASTNode::If(condition, if_block, elif_blocks, else_block) => {
+            let mut branches = vec![(condition, if_block)];
+            branches.extend(elif_blocks);
+            let mut else_block = else_block.map(|block| optimize_block(block, nodes));
+
+            let mut kept = Vec::new();
+            for (condition, block) in branches {
+                let condition = optimize_expr(condition, nodes);
+                let block = optimize_block(block, nodes);
+                match expr_to_value(&nodes[condition]) {
+                    // an always-true branch swallows everything after it
+                    Some(Value::Boolean(true)) => {
+                        else_block = Some(block);
+                        break;
+                    }
+                    // any other constant condition is never taken
+                    Some(_) => continue,
+                    None => kept.push((condition, block)),
+                }
+            }
+
+            if kept.is_empty() {
+                return else_block.unwrap_or_default();
+            }
+            let (first_condition, first_block) = kept.remove(0);
+            nodes[id] = ASTNode::If(first_condition, first_block, kept, else_block);
+            vec![id]
+        }
+        ASTNode::While(condition, body) => {
+            let condition = optimize_expr(condition, nodes);
+            if let Some(Value::Boolean(false)) = expr_to_value(&nodes[condition]) {
+                return Vec::new();
+            }
+            let body = optimize_block(body, nodes);
+            nodes[id] = ASTNode::While(condition, body);
+            vec![id]
+        }
+        ASTNode::For(init, condition, update, body) => {
+            // init and update are single var/assign statements, so the
+            // optimized form is always exactly one statement back
+            let init = optimize_statement(init, nodes).remove(0);
+            let condition = optimize_expr(condition, nodes);
+            if let Some(Value::Boolean(false)) = expr_to_value(&nodes[condition]) {
+                // the init still runs once, the loop itself never does
+                return vec![init];
+            }
+            let update = optimize_statement(update, nodes).remove(0);
+            let body = optimize_block(body, nodes);
+            nodes[id] = ASTNode::For(init, condition, update, body);
+            vec![id]
+        }
+        ASTNode::ParallelFor(mut header) => {
+            header.start = optimize_expr(header.start, nodes);
+            header.bound = optimize_expr(header.bound, nodes);
+            header.step = optimize_expr(header.step, nodes);
+            header.body = optimize_block(header.body, nodes);
+            nodes[id] = ASTNode::ParallelFor(header);
+            vec![id]
+        }
+        ASTNode::Type(expr) => {
+            let expr = optimize_expr(expr, nodes);
+            nodes[id] = ASTNode::Type(expr);
+            vec![id]
+        }
+        ASTNode::IndexAssign(target, index, value) => {
+            let target = optimize_expr(target, nodes);
+            let index = optimize_expr(index, nodes);
+            let value = optimize_expr(value, nodes);
+            nodes[id] = ASTNode::IndexAssign(target, index, value);
+            vec![id]
+        }
+        ASTNode::Append(array, value) => {
+            let array = optimize_expr(array, nodes);
+            let value = optimize_expr(value, nodes);
+            nodes[id] = ASTNode::Append(array, value);
+            vec![id]
+        }
+        ASTNode::Write(path, value) => {
+            let path = optimize_expr(path, nodes);
+            let value = optimize_expr(value, nodes);
+            nodes[id] = ASTNode::Write(path, value);
+            vec![id]
+        }
+        ASTNode::Return(value) => {
+            let value = value.map(|expr| optimize_expr(expr, nodes));
+            nodes[id] = ASTNode::Return(value);
+            vec![id]
+        }
+        ASTNode::Call(func, args) => {
+            nodes[id] = ASTNode::Call(func, args);
+            vec![optimize_expr(id, nodes)]
+        }
+        other => {
+            nodes[id] = other;
+            vec![id]
+        }
+    }
+}
+
+// expressions are rewritten in place and keep their node ids, so a post-order
+// walk with an explicit stack can fold every node after its children without
+// recursing - machine-generated chains of thousands of terms would otherwise
+// overflow the native stack. the second stack entry marks whether the node's
+// children have already been visited.
+fn optimize_expr(id: NodeId, nodes: &mut Vec<ASTNode>) -> NodeId {
+    let mut stack = vec![(id, false)];
+    while let Some((node, children_done)) = stack.pop() {
+        if children_done {
+            fold_expr(node, nodes);
+            continue;
+        }
+        stack.push((node, true));
+        match &nodes[node] {
+            ASTNode::BinaryOp(left, _, right)
+            | ASTNode::Index(left, right)
+            | ASTNode::Join(left, right) => {
+                let (left, right) = (*left, *right);
+                stack.push((left, false));
+                stack.push((right, false));
+            }
+            ASTNode::UnaryOp(_, expr)
+            | ASTNode::TypeCast(_, expr)
+            | ASTNode::Type(expr)
+            | ASTNode::Len(expr)
+            | ASTNode::ReadLine(Some(expr)) => stack.push((*expr, false)),
+            ASTNode::Substring(string, start, end) | ASTNode::Pad(string, start, end, _) => {
+                let (string, start, end) = (*string, *start, *end);
+                stack.push((string, false));
+                stack.push((start, false));
+                stack.push((end, false));
+            }
+            ASTNode::Call(_, args) | ASTNode::Array(args) => {
+                for &arg in args {
+                    stack.push((arg, false));
+                }
+            }
+            _ => {}
+        }
+    }
+    id
+}
+
+// fold one node whose children are already folded
+fn fold_expr(id: NodeId, nodes: &mut Vec<ASTNode>) {
+    let node = std::mem::replace(&mut nodes[id], ASTNode::Null);
+    match node {
+        ASTNode::BinaryOp(left, op, right) => {
+            // short-circuit operators can fold on the left operand alone,
+            // mirroring the fact that the right side never runs at runtime
+            if op == Token::And {
+                if let Some(Value::Boolean(false)) = expr_to_value(&nodes[left]) {
+                    nodes[id] = ASTNode::Boolean(false);
+                    return;
+                }
+            }
+            if op == Token::Or {
+                if let Some(Value::Boolean(true)) = expr_to_value(&nodes[left]) {
+                    nodes[id] = ASTNode::Boolean(true);
+                    return;
+                }
+            }
+            if let (Some(l), Some(r)) = (expr_to_value(&nodes[left]), expr_to_value(&nodes[right])) {
+                if let Some(folded) = fold_binary(&l, &op, &r) {
+                    nodes[id] = value_to_node(folded);
+                    return;
+                }
+            }
+            nodes[id] = ASTNode::BinaryOp(left, op, right);
+        }
+        ASTNode::UnaryOp(op, expr) => {
+            if op == Token::Not {
+                if let Some(Value::Boolean(b)) = expr_to_value(&nodes[expr]) {
+                    nodes[id] = ASTNode::Boolean(!b);
+                    return;
+                }
+            }
+            nodes[id] = ASTNode::UnaryOp(op, expr);
+        }
+        ASTNode::TypeCast(type_name, expr) => {
+            if let Some(value) = expr_to_value(&nodes[expr]) {
+                if let Some(folded) = fold_cast(&type_name, &value) {
+                    nodes[id] = value_to_node(folded);
+                    return;
+                }
+            }
+            nodes[id] = ASTNode::TypeCast(type_name, expr);
+        }
+        // everything else keeps its shape; the children were folded in place.
+        // calls are never folded themselves, and type() is kept because it
+        // prints a trace line in verbose mode
+        other => nodes[id] = other,
+    }
+}
+
+fn expr_to_value(node: &ASTNode) -> Option<Value> {
+    match node {
+        ASTNode::Number(n) => Some(Value::Number(*n)),
+        ASTNode::Float(f) => Some(Value::Float(*f)),
+        ASTNode::String(s) => Some(Value::String(Rc::new(s.clone()))),
+        ASTNode::Boolean(b) => Some(Value::Boolean(*b)),
+        ASTNode::Null => Some(Value::Null),
+        ASTNode::TypeLiteral(t) => Some(Value::Type(Rc::new(t.clone()))),
+        _ => None,
+    }
+}
+
+fn value_to_node(value: Value) -> ASTNode {
+    match value {
+        Value::Number(n) => ASTNode::Number(n),
+        Value::Float(f) => ASTNode::Float(f),
+        Value::String(s) => ASTNode::String((*s).clone()),
+        Value::Boolean(b) => ASTNode::Boolean(b),
+        Value::Null => ASTNode::Null,
+        Value::Type(t) => ASTNode::TypeLiteral((*t).clone()),
+        // never produced by expr_to_value or the fold helpers
+        Value::Array(_) => unreachable!("arrays are not folded"),
+    }
+}
+
+fn fold_binary(left: &Value, op: &Token, right: &Value) -> Option<Value> {
+    match (left, right) {
+        (Value::Number(l), Value::Number(r)) => {
+            let (l, r) = (*l, *r);
+            match op {
+                Token::Plus => l.checked_add(r).map(Value::Number),
+                Token::Minus => l.checked_sub(r).map(Value::Number),
+                Token::Multiply => l.checked_mul(r).map(Value::Number),
+                Token::Divide => Some(Value::Float(l as f64 / r as f64)),
+                Token::FloorDivide => l.checked_div(r).map(Value::Number),
+                Token::Modulus => l.checked_rem(r).map(Value::Number),
+                Token::Power => {
+                    // negative exponents produce a float at runtime and huge
+                    // ones overflow; only fold the plain checked integer case
+                    u32::try_from(r)
+                        .ok()
+                        .and_then(|exp| l.checked_pow(exp))
+                        .map(Value::Number)
+                }
+                Token::Equal => Some(Value::Boolean(l == r)),
+                Token::NotEqual => Some(Value::Boolean(l != r)),
+                Token::Greater => Some(Value::Boolean(l > r)),
+                Token::Less => Some(Value::Boolean(l < r)),
+                Token::GreaterEqual => Some(Value::Boolean(l >= r)),
+                Token::LessEqual => Some(Value::Boolean(l <= r)),
+                _ => None,
+            }
+        }
+        (Value::Float(_), Value::Float(_))
+        | (Value::Number(_), Value::Float(_))
+        | (Value::Float(_), Value::Number(_)) => {
+            let l = match left {
+                Value::Number(n) => *n as f64,
+                Value::Float(f) => *f,
+                _ => unreachable!(),
+            };
+            let r = match right {
+                Value::Number(n) => *n as f64,
+                Value::Float(f) => *f,
+                _ => unreachable!(),
+            };
+            match op {
+                Token::Plus => Some(Value::Float(l + r)),
+                Token::Minus => Some(Value::Float(l - r)),
+                Token::Multiply => Some(Value::Float(l * r)),
+                Token::Divide => Some(Value::Float(l / r)),
+                Token::FloorDivide => Some(Value::Number((l / r).floor() as i64)),
+                Token::Modulus => Some(Value::Float(l % r)),
+                Token::Power => Some(Value::Float(l.powf(r))),
+                Token::Equal => Some(Value::Boolean(l == r)),
+                Token::NotEqual => Some(Value::Boolean(l != r)),
+                Token::Greater => Some(Value::Boolean(l > r)),
+                Token::Less => Some(Value::Boolean(l < r)),
+                Token::GreaterEqual => Some(Value::Boolean(l >= r)),
+                Token::LessEqual => Some(Value::Boolean(l <= r)),
+                _ => None,
+            }
+        }
+        (Value::String(l), Value::String(r)) => match op {
+            Token::Plus => Some(Value::String(Rc::new((**l).clone() + r))),
+            Token::Equal => Some(Value::Boolean(l == r)),
+            Token::NotEqual => Some(Value::Boolean(l != r)),
+            _ => None,
+        },
+        // constant repetition folds only when the result stays small, so a
+        // huge count doesn't balloon the compiled program; everything else
+        // (including negative counts, a runtime error) is left to the vm
+        (Value::String(s), Value::Number(n)) => match op {
+            Token::Multiply
+                if (0..=4096).contains(n) && s.len().saturating_mul(*n as usize) <= 4096 =>
+            {
+                Some(Value::String(Rc::new(s.repeat(*n as usize))))
+            }
+            _ => None,
+        },
+        (Value::Boolean(l), Value::Boolean(r)) => match op {
+            Token::And => Some(Value::Boolean(*l && *r)),
+            Token::Or => Some(Value::Boolean(*l || *r)),
+            Token::Equal => Some(Value::Boolean(l == r)),
+            Token::NotEqual => Some(Value::Boolean(l != r)),
+            _ => None,
+        },
+        (Value::Type(l), Value::Type(r)) => match op {
+            Token::Equal => Some(Value::Boolean(l == r)),
+            Token::NotEqual => Some(Value::Boolean(l != r)),
+            _ => None,
+        },
+        _ => None,
+    }
+}
+
+fn fold_cast(type_name: &str, value: &Value) -> Option<Value> {
+    match type_name {
+        "int" => match value {
+            Value::Number(n) => Some(Value::Number(*n)),
+            Value::Float(f) => Some(Value::Number(*f as i64)),
+            Value::String(s) => {
+                if s.chars().all(|c| c.is_digit(10)) {
+                    s.parse::<i64>().ok().map(Value::Number)
+                } else {
+                    None
+                }
+            }
+            Value::Boolean(b) => Some(Value::Number(if *b { 1 } else { 0 })),
+            _ => None,
+        },
+        "str" => match value {
+            Value::Number(n) => Some(Value::String(Rc::new(n.to_string()))),
+            Value::Float(f) => Some(Value::String(Rc::new(f.to_string()))),
+            Value::String(s) => Some(Value::String(s.clone())),
+            Value::Boolean(b) => Some(Value::String(Rc::new(b.to_string()))),
+            Value::Null => Some(Value::String(Rc::new("null".to_string()))),
+            _ => None,
+        },
+        "float" => match value {
+            Value::Number(n) => Some(Value::Float(*n as f64)),
+            Value::Float(f) => Some(Value::Float(*f)),
+            Value::String(s) => s.parse::<f64>().ok().map(Value::Float),
+            Value::Boolean(b) => Some(Value::Float(if *b { 1.0 } else { 0.0 })),
+            _ => None,
+        },
+        "bool" => match value {
+            Value::Number(n) => Some(Value::Boolean(*n != 0)),
+            Value::Float(f) => Some(Value::Boolean(*f != 0.0)),
+            Value::String(s) => Some(Value::Boolean(!s.is_empty())),
+            Value::Boolean(b) => Some(Value::Boolean(*b)),
+            Value::Null => Some(Value::Boolean(false)),
+            _ => None,
+        },
+        _ => None,
+    }
+}
@@ -1,100 +1,366 @@
-use crate::lexer::{Lexer, Token};
+use crate::error;
+use crate::lexer::{tokenize, Span, Token};
+use std::cell::RefCell;
 use std::collections::HashMap;
+use std::fmt;
+use std::rc::Rc;
 
-#[derive(Debug, Clone)]
+// string payloads are reference-counted so cloning a Value is pointer-sized:
+// loads, stores and constant pushes bump a refcount instead of memcpy-ing the
+// whole string. the enum itself stays at 16 bytes. arrays are contiguous Vecs
+// behind the same kind of shared pointer, so passing one around never copies
+// the elements and writes through any handle are seen by all of them.
+#[derive(Clone)]
 pub enum Value {
-    Number(i32),
-    String(String),
+    Number(i64),
+    String(Rc<String>),
     Boolean(bool),
-    Float(f64), 
+    Float(f64),
     Null,
-    Type(String),
-    Break,
-    Continue,
+    Type(Rc<String>),
+    Array(Rc<RefCell<Vec<Value>>>),
 }
 
-#[derive(Debug)]
+// hand-written so array values read as Array([Number(1), ...]) in the verbose
+// trace instead of exposing the RefCell wrapper; scalars match the derived form
+impl fmt::Debug for Value {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            Value::Number(n) => write!(f, "Number({:?})", n),
+            Value::String(s) => write!(f, "String({:?})", s),
+            Value::Boolean(b) => write!(f, "Boolean({:?})", b),
+            Value::Float(x) => write!(f, "Float({:?})", x),
+            Value::Null => write!(f, "Null"),
+            Value::Type(t) => write!(f, "Type({:?})", t),
+            Value::Array(a) => write!(f, "Array({:?})", a.borrow()),
+        }
+    }
+}
+
+// index of a node in the Program arena
+pub type NodeId = usize;
+
+// which frame a resolved variable lives in: the one global frame, or the
+// call frame of the function whose body is being parsed
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum Slot {
+    Global(usize),
+    Local(usize),
+}
+
+// nodes reference their children by index into one contiguous arena instead of
+// through a Box per operand, so walking an expression stays inside one
+// allocation instead of chasing pointers all over the heap.
+#[derive(Debug, Clone)]
 pub enum ASTNode {
-    Number(i32),
+    Number(i64),
     String(String),
     Boolean(bool),
-    Float(f64), 
+    Float(f64),
     Null,
-    BinaryOp(Box<ASTNode>, Token, Box<ASTNode>),
-    Print(Box<ASTNode>),
-    Var(String, Option<Box<ASTNode>>, bool),
-    Assign(String, Box<ASTNode>),
-    UnaryOp(Token, Box<ASTNode>),
-    Identifier(String),
-    Index(Box<ASTNode>, Box<ASTNode>),
-    Type(Box<ASTNode>),
+    BinaryOp(NodeId, Token, NodeId),
+    Print(NodeId),
+    Var(Slot, Option<NodeId>, bool),
+    Assign(Slot, NodeId),
+    UnaryOp(Token, NodeId),
+    Identifier(Slot),
+    Array(Vec<NodeId>),
+    IndexAssign(NodeId, NodeId, NodeId),
+    Len(NodeId),
+    Append(NodeId, NodeId),
+    Substring(NodeId, NodeId, NodeId),
+    Join(NodeId, NodeId),
+    // string, width, fill; true pads on the left (right-aligns)
+    Pad(NodeId, NodeId, NodeId, bool),
+    // next line from a file, or from stdin when no path is given
+    ReadLine(Option<NodeId>),
+    // path, value: append one line to a file
+    Write(NodeId, NodeId),
+    Call(usize, Vec<NodeId>),
+    Return(Option<NodeId>),
+    // marks where a definition appeared; the body lives in Program::functions
+    FuncDef,
+    Index(NodeId, NodeId),
+    Type(NodeId),
     TypeLiteral(String),
-    TypeCast(String, Box<ASTNode>),
-    If(Box<ASTNode>, Vec<ASTNode>, Vec<(ASTNode, Vec<ASTNode>)>, Option<Vec<ASTNode>>),
-    For(Box<ASTNode>, Box<ASTNode>, Box<ASTNode>, Vec<ASTNode>),
-    While(Box<ASTNode>, Vec<ASTNode>),
+    TypeCast(String, NodeId),
+    If(NodeId, Vec<NodeId>, Vec<(NodeId, Vec<NodeId>)>, Option<Vec<NodeId>>),
+    For(NodeId, NodeId, NodeId, Vec<NodeId>),
+    ParallelFor(ParallelFor),
+    While(NodeId, Vec<NodeId>),
     Break,
     Continue,
 }
 
+// a `parallel for` header, restricted to the canonical counted form
+// `parallel for (var i = start; i OP bound; i = i +/- step)` so the vm can
+// enumerate the iterations upfront and hand them to a worker pool. the
+// compiler checks the body only writes iteration-local variables.
+#[derive(Debug, Clone)]
+pub struct ParallelFor {
+    // global slot of the loop variable
+    pub var: usize,
+    pub start: NodeId,
+    // loop condition: comparison of the loop variable against `bound`
+    pub op: Token,
+    pub bound: NodeId,
+    // update: Plus or Minus of `step` onto the loop variable
+    pub step_op: Token,
+    pub step: NodeId,
+    pub body: Vec<NodeId>,
+}
+
+// a user-defined function: parameters occupy the first `params` local slots,
+// and every call gets a contiguous frame of `local_names.len()` slots.
+// an entry exists from the first mention of the name, so calls can appear
+// before the definition; `defined` says whether a body was actually seen.
+#[derive(Debug, Clone)]
+pub struct FuncDecl {
+    pub name: String,
+    pub params: usize,
+    pub body: Vec<NodeId>,
+    pub local_names: Vec<String>,
+    pub defined: bool,
+}
+
+// the whole parsed program: the node arena plus the top-level statement list
+#[derive(Debug)]
+pub struct Program {
+    pub nodes: Vec<ASTNode>,
+    pub statements: Vec<NodeId>,
+    pub functions: Vec<FuncDecl>,
+}
+
+// parse-time info about a variable: which frame slot it lives in, whether a
+// declaration for it has been seen yet, and whether it is mutable.
+#[derive(Clone)]
+struct SlotInfo {
+    slot: usize,
+    declared: bool,
+    is_mutable: bool,
+}
+
+// the bookkeeping a parser accumulates, detachable so a repl can carry
+// declarations, slot assignments and function definitions over to the next
+// input. the node arena rides along because function bodies reference it.
+#[derive(Clone, Default)]
+pub struct SymbolState {
+    symbol_table: HashMap<String, SlotInfo>,
+    slot_names: Vec<String>,
+    nodes: Vec<ASTNode>,
+    func_table: HashMap<String, usize>,
+    functions: Vec<FuncDecl>,
+}
+
+impl SymbolState {
+    // take the arena and function list back from a program that has been run,
+    // so the next input can still call the functions defined in this one
+    pub fn adopt(&mut self, program: Program) {
+        self.nodes = program.nodes;
+        self.functions = program.functions;
+    }
+}
+
+// variable bookkeeping for one function body; dropped when the body ends
+#[derive(Default)]
+struct LocalScope {
+    symbol_table: HashMap<String, SlotInfo>,
+    slot_names: Vec<String>,
+}
+
 pub struct Parser<'a> {
-    lexer: Lexer<'a>,
+    src: &'a str,
+    // the whole input, lexed upfront; walking it is an index bump and any
+    // amount of lookahead is just a bigger index
+    tokens: Vec<Token>,
+    // identifier id -> text, shared with the tokens
+    names: Vec<&'a str>,
+    // byte offset of each token, for error positions
+    offsets: Vec<u32>,
+    pos: usize,
     current_token: Token,
-    symbol_table: HashMap<String, bool>,
+    symbol_table: HashMap<String, SlotInfo>,
+    slot_names: Vec<String>,
+    nodes: Vec<ASTNode>,
+    func_table: HashMap<String, usize>,
+    functions: Vec<FuncDecl>,
+    // Some while parsing a function body
+    locals: Option<LocalScope>,
 }
 
 impl<'a> Parser<'a> {
     pub fn new(input: &'a str) -> Self {
-        let mut lexer = Lexer::new(input);
-        let current_token = lexer.next_token();
+        Parser::with_state(input, SymbolState::default())
+    }
+
+    // continue parsing against the declarations of an earlier input
+    pub fn with_state(input: &'a str, state: SymbolState) -> Self {
+        let lexed = tokenize(input);
+        let current_token = lexed.tokens[0];
         Parser {
-            lexer,
+            src: input,
+            tokens: lexed.tokens,
+            names: lexed.names,
+            offsets: lexed.offsets,
+            pos: 0,
             current_token,
-            symbol_table: HashMap::new(),
+            symbol_table: state.symbol_table,
+            slot_names: state.slot_names,
+            nodes: state.nodes,
+            func_table: state.func_table,
+            functions: state.functions,
+            locals: None,
+        }
+    }
+
+    // parse() moves the arena and functions into the Program; the repl hands
+    // them back through SymbolState::adopt once the program has run
+    pub fn into_state(self) -> SymbolState {
+        SymbolState {
+            symbol_table: self.symbol_table,
+            slot_names: self.slot_names,
+            nodes: self.nodes,
+            func_table: self.func_table,
+            functions: self.functions,
+        }
+    }
+
+    fn add(&mut self, node: ASTNode) -> NodeId {
+        self.nodes.push(node);
+        self.nodes.len() - 1
+    }
+
+    // every variable gets a numeric slot the first time its name shows up, so
+    // the vm can use a flat Vec frame instead of hashing names at runtime.
+    // names referenced before any declaration still get a slot; the vm reports
+    // them only if the access is actually executed, like the old interpreter.
+    // inside a function body, names resolve to the function's own slots first,
+    // then to globals; anything unknown becomes a function local so the
+    // "Variable not found" error still fires per call.
+    fn resolve_slot(&mut self, name: &str) -> Slot {
+        if let Some(scope) = &mut self.locals {
+            if let Some(info) = scope.symbol_table.get(name) {
+                return Slot::Local(info.slot);
+            }
+            if let Some(info) = self.symbol_table.get(name) {
+                return Slot::Global(info.slot);
+            }
+            let slot = scope.slot_names.len();
+            scope.slot_names.push(name.to_string());
+            scope.symbol_table.insert(name.to_string(), SlotInfo {
+                slot,
+                declared: false,
+                is_mutable: true,
+            });
+            return Slot::Local(slot);
+        }
+        if let Some(info) = self.symbol_table.get(name) {
+            Slot::Global(info.slot)
+        } else {
+            let slot = self.slot_names.len();
+            self.slot_names.push(name.to_string());
+            self.symbol_table.insert(name.to_string(), SlotInfo {
+                slot,
+                declared: false,
+                is_mutable: true,
+            });
+            Slot::Global(slot)
+        }
+    }
+
+    // functions get an id on first mention too, so a call can precede the
+    // definition; the compiler rejects calls to names never defined
+    fn resolve_func(&mut self, name: &str) -> usize {
+        if let Some(&func) = self.func_table.get(name) {
+            func
+        } else {
+            let func = self.functions.len();
+            self.func_table.insert(name.to_string(), func);
+            self.functions.push(FuncDecl {
+                name: name.to_string(),
+                params: 0,
+                body: Vec::new(),
+                local_names: Vec::new(),
+                defined: false,
+            });
+            func
         }
     }
 
+    pub fn slots(&self) -> Vec<String> {
+        self.slot_names.clone()
+    }
+
     fn eat(&mut self, token: Token) {
         if self.current_token == token {
-            self.current_token = self.lexer.next_token();
+            // the vector is EOF-terminated, so the cursor never runs off it
+            self.pos = (self.pos + 1).min(self.tokens.len() - 1);
+            self.current_token = self.tokens[self.pos];
         } else {
-            panic!("Unexpected token: {:?}, expected: {:?}", self.current_token, token);
+            self.fail(format!(
+                "Unexpected token: {:?}, expected: {:?}",
+                self.current_token, token
+            ));
         }
     }
 
-    pub fn parse(&mut self) -> Vec<ASTNode> {
-        let mut ast_nodes = Vec::new();
+    // text behind a span handed out by the lexer
+    fn slice(&self, span: Span) -> &'a str {
+        &self.src[span.start..span.end]
+    }
+
+    // text of an interned identifier
+    fn name(&self, sym: u32) -> &'a str {
+        self.names[sym as usize]
+    }
+
+    // abort with the position of the current token attached
+    fn fail(&self, message: String) -> ! {
+        error::fail(message, self.src, self.offsets[self.pos] as usize)
+    }
+
+    pub fn parse(&mut self) -> Program {
+        let mut statements = Vec::new();
         while self.current_token != Token::EOF {
-            ast_nodes.push(self.parse_statement());
+            statements.push(self.parse_statement());
+        }
+        Program {
+            nodes: std::mem::take(&mut self.nodes),
+            statements,
+            functions: std::mem::take(&mut self.functions),
         }
-        ast_nodes
     }
 
-    fn parse_statement(&mut self) -> ASTNode {
+    fn parse_statement(&mut self) -> NodeId {
         match &self.current_token {
             Token::Var | Token::NoVar => self.parse_var_decl(),
             Token::Identifier(_) => self.parse_assign_stmt(),
             Token::Print => self.parse_print(),
             Token::If => self.parse_if_statement(),
             Token::For => self.parse_for_loop(),
+            Token::Parallel => self.parse_parallel_for(),
+            Token::Append => self.parse_append(),
+            Token::Write => self.parse_write(),
             Token::Break => self.parse_break(),
             Token::Continue => self.parse_continue(),
             Token::While => self.parse_while_loop(),
             Token::Type => self.parse_type(),
-            _ => panic!("Unexpected token in statement: {:?}", self.current_token),
+            Token::Func => self.parse_func_def(),
+            Token::Return => self.parse_return(),
+            _ => self.fail(format!("Unexpected token in statement: {:?}", self.current_token)),
         }
     }
 
-    fn parse_type(&mut self) -> ASTNode {
+    fn parse_type(&mut self) -> NodeId {
         self.eat(Token::Type);
         self.eat(Token::LParen);
         let expr = self.parse_expr();
         self.eat(Token::RParen);
         self.eat(Token::Semicolon);
-        ASTNode::Type(Box::new(expr))
+        self.add(ASTNode::Type(expr))
     }
 
-    fn parse_while_loop(&mut self) -> ASTNode {
+    fn parse_while_loop(&mut self) -> NodeId {
         self.eat(Token::While);
         self.eat(Token::LParen);
         let condition = self.parse_expr();
@@ -103,10 +369,10 @@ impl<'a> Parser<'a> {
         let body = self.parse_block();
         self.eat(Token::RBrace);
 
-        ASTNode::While(Box::new(condition), body)
+        self.add(ASTNode::While(condition, body))
     }
 
-    fn parse_if_statement(&mut self) -> ASTNode {
+    fn parse_if_statement(&mut self) -> NodeId {
         self.eat(Token::If);
         self.eat(Token::LParen);
         let condition = self.parse_expr();
@@ -136,45 +402,248 @@ impl<'a> Parser<'a> {
             self.eat(Token::RBrace);
         }
 
-        ASTNode::If(Box::new(condition), if_block, elif_blocks, else_block)
+        self.add(ASTNode::If(condition, if_block, elif_blocks, else_block))
     }
 
-    fn parse_for_loop(&mut self) -> ASTNode {
+    fn parse_for_loop(&mut self) -> NodeId {
         self.eat(Token::For);
         self.eat(Token::LParen);
-        
+
         let init = if let Token::Var | Token::NoVar = self.current_token {
             self.parse_var_decl()
         } else {
             self.parse_assign_stmt()
         };
-        
+
+        let condition = self.parse_expr();
+        self.eat(Token::Semicolon);
+
+        let update = self.parse_assign_stmt();
+        self.eat(Token::RParen);
+
+        self.eat(Token::LBrace);
+        let body = self.parse_block();
+        self.eat(Token::RBrace);
+
+        self.add(ASTNode::For(init, condition, update, body))
+    }
+
+    // `parallel for` runs independent iterations across a worker pool. only
+    // the canonical counted form is accepted: the loop variable must be
+    // declared in the header, the condition must compare it against a bound,
+    // and the update must add or subtract a step - that is what lets the
+    // iterations be enumerated before any body runs.
+    fn parse_parallel_for(&mut self) -> NodeId {
+        self.eat(Token::Parallel);
+        if self.locals.is_some() {
+            self.fail("parallel for inside a function is not supported".to_string());
+        }
+        self.eat(Token::For);
+        self.eat(Token::LParen);
+
+        if self.current_token != Token::Var {
+            self.fail("parallel for must declare its loop variable with 'var'".to_string());
+        }
+        let init = self.parse_var_decl();
+        let (var, start) = match self.nodes[init] {
+            ASTNode::Var(Slot::Global(slot), Some(start), true) => (slot, start),
+            _ => self.fail("parallel for loop variable needs an initial value".to_string()),
+        };
+
         let condition = self.parse_expr();
+        let op = match self.nodes[condition] {
+            ASTNode::BinaryOp(left, op, _)
+                if matches!(self.nodes[left], ASTNode::Identifier(Slot::Global(s)) if s == var)
+                    && matches!(
+                        op,
+                        Token::Less
+                            | Token::LessEqual
+                            | Token::Greater
+                            | Token::GreaterEqual
+                            | Token::NotEqual
+                    ) =>
+            {
+                op
+            }
+            _ => self.fail(
+                "parallel for condition must compare the loop variable against a bound"
+                    .to_string(),
+            ),
+        };
+        let bound = match self.nodes[condition] {
+            ASTNode::BinaryOp(_, _, right) => right,
+            _ => unreachable!(),
+        };
         self.eat(Token::Semicolon);
-        
+
         let update = self.parse_assign_stmt();
+        let (step_op, step) = match self.nodes[update] {
+            ASTNode::Assign(Slot::Global(slot), expr) if slot == var => match self.nodes[expr] {
+                ASTNode::BinaryOp(left, op @ (Token::Plus | Token::Minus), step)
+                    if matches!(
+                        self.nodes[left],
+                        ASTNode::Identifier(Slot::Global(s)) if s == var
+                    ) =>
+                {
+                    (op, step)
+                }
+                _ => self.fail(
+                    "parallel for update must add or subtract a step from the loop variable"
+                        .to_string(),
+                ),
+            },
+            _ => self.fail(
+                "parallel for update must assign to the loop variable".to_string(),
+            ),
+        };
         self.eat(Token::RParen);
 
         self.eat(Token::LBrace);
         let body = self.parse_block();
         self.eat(Token::RBrace);
 
-        ASTNode::For(Box::new(init), Box::new(condition), Box::new(update), body)
+        self.add(ASTNode::ParallelFor(ParallelFor {
+            var,
+            start,
+            op,
+            bound,
+            step_op,
+            step,
+            body,
+        }))
+    }
+
+    fn parse_append(&mut self) -> NodeId {
+        self.eat(Token::Append);
+        self.eat(Token::LParen);
+        let array = self.parse_expr();
+        self.eat(Token::Comma);
+        let value = self.parse_expr();
+        self.eat(Token::RParen);
+        self.eat(Token::Semicolon);
+        self.add(ASTNode::Append(array, value))
     }
-    
-    fn parse_break(&mut self) -> ASTNode {
+
+    fn parse_write(&mut self) -> NodeId {
+        self.eat(Token::Write);
+        self.eat(Token::LParen);
+        let path = self.parse_expr();
+        self.eat(Token::Comma);
+        let value = self.parse_expr();
+        self.eat(Token::RParen);
+        self.eat(Token::Semicolon);
+        self.add(ASTNode::Write(path, value))
+    }
+
+    fn parse_func_def(&mut self) -> NodeId {
+        self.eat(Token::Func);
+        if self.locals.is_some() {
+            self.fail("Nested function definitions are not supported".to_string());
+        }
+
+        let name = if let Token::Identifier(sym) = self.current_token {
+            let name = self.name(sym).to_string();
+            self.eat(self.current_token);
+            name
+        } else {
+            self.fail("Expected identifier in function definition".to_string());
+        };
+
+        let func = self.resolve_func(&name);
+        if self.functions[func].defined {
+            self.fail(format!("Function '{}' has already been declared", name));
+        }
+
+        // parameters become the first local slots, already declared
+        let mut scope = LocalScope::default();
+        self.eat(Token::LParen);
+        while self.current_token != Token::RParen {
+            let param = if let Token::Identifier(sym) = self.current_token {
+                let param = self.name(sym).to_string();
+                self.eat(self.current_token);
+                param
+            } else {
+                self.fail(format!(
+                    "Expected identifier in parameter list, got: {:?}",
+                    self.current_token
+                ));
+            };
+            if scope.symbol_table.contains_key(&param) {
+                self.fail(format!("Duplicate parameter '{}' in function '{}'", param, name));
+            }
+            scope.symbol_table.insert(param.clone(), SlotInfo {
+                slot: scope.slot_names.len(),
+                declared: true,
+                is_mutable: true,
+            });
+            scope.slot_names.push(param);
+            if self.current_token == Token::Comma {
+                self.eat(Token::Comma);
+            } else {
+                break;
+            }
+        }
+        self.eat(Token::RParen);
+        let params = scope.slot_names.len();
+
+        self.eat(Token::LBrace);
+        self.locals = Some(scope);
+        let body = self.parse_block();
+        self.eat(Token::RBrace);
+        let scope = self.locals.take().unwrap();
+
+        let decl = &mut self.functions[func];
+        decl.params = params;
+        decl.body = body;
+        decl.local_names = scope.slot_names;
+        decl.defined = true;
+
+        self.add(ASTNode::FuncDef)
+    }
+
+    fn parse_return(&mut self) -> NodeId {
+        self.eat(Token::Return);
+        if self.locals.is_none() {
+            self.fail("Return statement outside of function".to_string());
+        }
+        let value = if self.current_token == Token::Semicolon {
+            None
+        } else {
+            Some(self.parse_expr())
+        };
+        self.eat(Token::Semicolon);
+        self.add(ASTNode::Return(value))
+    }
+
+    fn parse_call(&mut self, name: &str) -> NodeId {
+        let func = self.resolve_func(name);
+        self.eat(Token::LParen);
+        let mut args = Vec::new();
+        while self.current_token != Token::RParen {
+            args.push(self.parse_expr());
+            if self.current_token == Token::Comma {
+                self.eat(Token::Comma);
+            } else {
+                break;
+            }
+        }
+        self.eat(Token::RParen);
+        self.add(ASTNode::Call(func, args))
+    }
+
+    fn parse_break(&mut self) -> NodeId {
         self.eat(Token::Break);
         self.eat(Token::Semicolon);
-        ASTNode::Break
+        self.add(ASTNode::Break)
     }
 
-    fn parse_continue(&mut self) -> ASTNode {
+    fn parse_continue(&mut self) -> NodeId {
         self.eat(Token::Continue);
         self.eat(Token::Semicolon);
-        ASTNode::Continue
+        self.add(ASTNode::Continue)
     }
 
-    fn parse_block(&mut self) -> Vec<ASTNode> {
+    fn parse_block(&mut self) -> Vec<NodeId> {
         let mut statements = Vec::new();
         while self.current_token != Token::RBrace {
             statements.push(self.parse_statement());
@@ -182,64 +651,64 @@ impl<'a> Parser<'a> {
         statements
     }
 
-    fn parse_expr(&mut self) -> ASTNode {
+    fn parse_expr(&mut self) -> NodeId {
         self.parse_logical_or()
     }
 
-    fn parse_logical_or(&mut self) -> ASTNode {
+    fn parse_logical_or(&mut self) -> NodeId {
         let mut node = self.parse_logical_and();
 
         while self.current_token == Token::Or {
-            let op = self.current_token.clone();
+            let op = self.current_token;
             self.eat(Token::Or);
             let right = self.parse_logical_and();
-            node = ASTNode::BinaryOp(Box::new(node), op, Box::new(right));
+            node = self.add(ASTNode::BinaryOp(node, op, right));
         }
 
         node
     }
 
-    fn parse_logical_and(&mut self) -> ASTNode {
+    fn parse_logical_and(&mut self) -> NodeId {
         let mut node = self.parse_comparison();
 
         while self.current_token == Token::And {
-            let op = self.current_token.clone();
+            let op = self.current_token;
             self.eat(Token::And);
             let right = self.parse_comparison();
-            node = ASTNode::BinaryOp(Box::new(node), op, Box::new(right));
+            node = self.add(ASTNode::BinaryOp(node, op, right));
         }
 
         node
     }
 
-    fn parse_comparison(&mut self) -> ASTNode {
+    fn parse_comparison(&mut self) -> NodeId {
         let mut node = self.parse_arithmetic();
-    
+
         loop {
             match &self.current_token {
                 Token::Equal | Token::NotEqual | Token::Greater | Token::Less | Token::GreaterEqual | Token::LessEqual => {
-                    let op = self.current_token.clone();
-                    self.eat(op.clone());
+                    let op = self.current_token;
+                    self.eat(op);
                     let right = self.parse_arithmetic();
-                    node = ASTNode::BinaryOp(Box::new(node), op, Box::new(right));
+                    node = self.add(ASTNode::BinaryOp(node, op, right));
                 }
                 _ => break,
             }
         }
-    
+
         node
     }
 
-    fn parse_arithmetic(&mut self) -> ASTNode {
+    fn parse_arithmetic(&mut self) -> NodeId {
         let mut node = self.parse_term();
 
         loop {
             match &self.current_token {
                 Token::Plus | Token::Minus => {
-                    let op = self.current_token.clone();
-                    self.eat(op.clone());
+                    let op = self.current_token;
+                    self.eat(op);
                     let right = self.parse_term();
-                    node = ASTNode::BinaryOp(Box::new(node), op, Box::new(right));
+                    node = self.add(ASTNode::BinaryOp(node, op, right));
                 }
                 _ => break,
             }
@@ -248,73 +717,74 @@ impl<'a> Parser<'a> {
         node
     }
 
-        fn parse_term(&mut self) -> ASTNode {
-            let mut node = self.parse_power(); 
-        
-            loop {
-                match &self.current_token {
-                    Token::Multiply => {
-                        self.eat(Token::Multiply);
-                        let right = self.parse_power(); 
-                        node = ASTNode::BinaryOp(Box::new(node), Token::Multiply, Box::new(right));
-                    }
-                    Token::Divide => {
+    fn parse_term(&mut self) -> NodeId {
+        let mut node = self.parse_power();
+
+        loop {
+            match &self.current_token {
+                Token::Multiply => {
+                    self.eat(Token::Multiply);
+                    let right = self.parse_power();
+                    node = self.add(ASTNode::BinaryOp(node, Token::Multiply, right));
+                }
+                Token::Divide => {
+                    self.eat(Token::Divide);
+                    if self.current_token == Token::Divide {
                         self.eat(Token::Divide);
-                        if self.current_token == Token::Divide {
-                            self.eat(Token::Divide);
-                            let right = self.parse_power(); 
-                            node = ASTNode::BinaryOp(Box::new(node), Token::FloorDivide, Box::new(right));
-                        } else {
-                            let right = self.parse_power(); 
-                            node = ASTNode::BinaryOp(Box::new(node), Token::Divide, Box::new(right));
-                        }
+                        let right = self.parse_power();
+                        node = self.add(ASTNode::BinaryOp(node, Token::FloorDivide, right));
+                    } else {
+                        let right = self.parse_power();
+                        node = self.add(ASTNode::BinaryOp(node, Token::Divide, right));
                     }
-                    Token::Modulus => {
-                        self.eat(Token::Modulus);
-                        let right = self.parse_power(); 
-                        node = ASTNode::BinaryOp(Box::new(node), Token::Modulus, Box::new(right));
-                    }
-                    _ => break,
                 }
+                Token::Modulus => {
+                    self.eat(Token::Modulus);
+                    let right = self.parse_power();
+                    node = self.add(ASTNode::BinaryOp(node, Token::Modulus, right));
+                }
+                _ => break,
             }
-        
-            node
         }
 
-    fn parse_power(&mut self) -> ASTNode {
+        node
+    }
+
+    fn parse_power(&mut self) -> NodeId {
         let mut node = self.parse_factor();
 
         while self.current_token == Token::Power {
-            let op = self.current_token.clone();
+            let op = self.current_token;
             self.eat(Token::Power);
-            let right = self.parse_factor(); 
-            node = ASTNode::BinaryOp(Box::new(node), op, Box::new(right));
+            let right = self.parse_factor();
+            node = self.add(ASTNode::BinaryOp(node, op, right));
         }
 
         node
     }
 
-    fn parse_factor(&mut self) -> ASTNode {
+    fn parse_factor(&mut self) -> NodeId {
         match &self.current_token {
             Token::Minus => {
                 self.eat(Token::Minus);
+                let zero = self.add(ASTNode::Number(0));
                 let factor = self.parse_factor();
-                ASTNode::BinaryOp(Box::new(ASTNode::Number(0)), Token::Minus, Box::new(factor))
+                self.add(ASTNode::BinaryOp(zero, Token::Minus, factor))
             }
             Token::Number(val) => {
                 let num = *val;
                 self.eat(Token::Number(num));
-                ASTNode::Number(num)
+                self.add(ASTNode::Number(num))
             }
             Token::Not => {
                 self.eat(Token::Not);
                 let factor = self.parse_factor();
-                ASTNode::UnaryOp(Token::Not, Box::new(factor))
+                self.add(ASTNode::UnaryOp(Token::Not, factor))
             },
             Token::Float(val) => {
                 let num = *val;
                 self.eat(Token::Float(num));
-                ASTNode::Float(num)
+                self.add(ASTNode::Float(num))
             }
             Token::LParen => {
                 self.eat(Token::LParen);
@@ -322,55 +792,110 @@ impl<'a> Parser<'a> {
                 self.eat(Token::RParen);
                 expr
             }
-            Token::Identifier(_) | Token::String(_) | Token::Boolean(_) | Token::Null | Token::TypeLiteral(_) | Token::TypeCast(_) | Token::Type => {
+            Token::Identifier(_) | Token::String(_) | Token::Boolean(_) | Token::Null | Token::TypeLiteral(_) | Token::TypeCast(_) | Token::Type | Token::LBracket | Token::Len | Token::Substring | Token::Join | Token::LPad | Token::RPad | Token::ReadLine => {
                 self.parse_primary()
             }
-            _ => panic!("Unexpected token in factor: {:?}", self.current_token),
+            _ => self.fail(format!("Unexpected token in factor: {:?}", self.current_token)),
         }
     }
 
-    fn parse_primary(&mut self) -> ASTNode {
+    fn parse_primary(&mut self) -> NodeId {
         match &self.current_token {
             Token::Number(val) => {
                 let num = *val;
                 self.eat(Token::Number(num));
-                ASTNode::Number(num)
+                self.add(ASTNode::Number(num))
             }
-            Token::Float(val) => { 
+            Token::Float(val) => {
                 let num = *val;
                 self.eat(Token::Float(num));
-                ASTNode::Float(num)
+                self.add(ASTNode::Float(num))
             }
-            Token::String(val) => {
-                let s = val.clone();
-                self.eat(Token::String(s.clone()));
-                ASTNode::String(s)
+            Token::String(span) => {
+                let s = self.slice(*span).to_string();
+                self.eat(self.current_token);
+                self.add(ASTNode::String(s))
             }
             Token::Boolean(val) => {
                 let b = *val;
                 self.eat(Token::Boolean(b));
-                ASTNode::Boolean(b)
+                self.add(ASTNode::Boolean(b))
             }
-            Token::Identifier(var_name) => {
-                let name = var_name.clone();
-                self.eat(Token::Identifier(name.clone()));
-                if self.current_token == Token::LBracket {
-                    self.parse_index(ASTNode::Identifier(name))
-                } else {
-                    ASTNode::Identifier(name)
+            Token::Identifier(sym) => {
+                let name = self.name(*sym).to_string();
+                self.eat(self.current_token);
+                if self.current_token == Token::LParen {
+                    return self.parse_call(&name);
+                }
+                let slot = self.resolve_slot(&name);
+                let mut node = self.add(ASTNode::Identifier(slot));
+                while self.current_token == Token::LBracket {
+                    node = self.parse_index(node);
                 }
+                node
             }
-            Token::TypeLiteral(type_name) => {
-                let name = type_name.clone();
-                self.eat(Token::TypeLiteral(name.clone()));
-                ASTNode::TypeLiteral(name)
+            Token::TypeLiteral(span) => {
+                let name = self.slice(*span).to_string();
+                self.eat(self.current_token);
+                self.add(ASTNode::TypeLiteral(name))
             }
-            Token::TypeCast(type_name) => {
-                self.parse_type_cast(type_name.clone())
+            Token::TypeCast(_) => {
+                self.parse_type_cast()
             }
             Token::Null => {
                 self.eat(Token::Null);
-                ASTNode::Null
+                self.add(ASTNode::Null)
+            }
+            Token::LBracket => self.parse_array_literal(),
+            Token::Len => {
+                self.eat(Token::Len);
+                self.eat(Token::LParen);
+                let expr = self.parse_expr();
+                self.eat(Token::RParen);
+                self.add(ASTNode::Len(expr))
+            }
+            Token::Substring => {
+                self.eat(Token::Substring);
+                self.eat(Token::LParen);
+                let string = self.parse_expr();
+                self.eat(Token::Comma);
+                let start = self.parse_expr();
+                self.eat(Token::Comma);
+                let end = self.parse_expr();
+                self.eat(Token::RParen);
+                self.add(ASTNode::Substring(string, start, end))
+            }
+            Token::Join => {
+                self.eat(Token::Join);
+                self.eat(Token::LParen);
+                let array = self.parse_expr();
+                self.eat(Token::Comma);
+                let separator = self.parse_expr();
+                self.eat(Token::RParen);
+                self.add(ASTNode::Join(array, separator))
+            }
+            Token::LPad | Token::RPad => {
+                let left = self.current_token == Token::LPad;
+                self.eat(self.current_token);
+                self.eat(Token::LParen);
+                let string = self.parse_expr();
+                self.eat(Token::Comma);
+                let width = self.parse_expr();
+                self.eat(Token::Comma);
+                let fill = self.parse_expr();
+                self.eat(Token::RParen);
+                self.add(ASTNode::Pad(string, width, fill, left))
+            }
+            Token::ReadLine => {
+                self.eat(Token::ReadLine);
+                self.eat(Token::LParen);
+                let path = if self.current_token == Token::RParen {
+                    None
+                } else {
+                    Some(self.parse_expr())
+                };
+                self.eat(Token::RParen);
+                self.add(ASTNode::ReadLine(path))
             }
             Token::LParen => {
                 self.eat(Token::LParen);
@@ -383,85 +908,163 @@ impl<'a> Parser<'a> {
                 self.eat(Token::LParen);
                 let expr = self.parse_expr();
                 self.eat(Token::RParen);
-                ASTNode::Type(Box::new(expr))
+                self.add(ASTNode::Type(expr))
+            }
+            _ => self.fail(format!("Unexpected token in primary: {:?}", self.current_token)),
+        }
+    }
+
+    fn parse_array_literal(&mut self) -> NodeId {
+        self.eat(Token::LBracket);
+        let mut elements = Vec::new();
+        while self.current_token != Token::RBracket {
+            elements.push(self.parse_expr());
+            if self.current_token == Token::Comma {
+                self.eat(Token::Comma);
+            } else {
+                break;
             }
-            _ => panic!("Unexpected token in primary: {:?}", self.current_token),
         }
+        self.eat(Token::RBracket);
+        self.add(ASTNode::Array(elements))
     }
 
-    fn parse_index(&mut self, expr: ASTNode) -> ASTNode {
+    fn parse_index(&mut self, expr: NodeId) -> NodeId {
         self.eat(Token::LBracket);
         let index = self.parse_expr();
         self.eat(Token::RBracket);
-        ASTNode::Index(Box::new(expr), Box::new(index))
+        self.add(ASTNode::Index(expr, index))
     }
 
-    fn parse_type_cast(&mut self, type_name: String) -> ASTNode {
-        self.eat(Token::TypeCast(type_name.clone()));
+    fn parse_type_cast(&mut self) -> NodeId {
+        let type_name = if let Token::TypeCast(span) = self.current_token {
+            self.slice(span).to_string()
+        } else {
+            self.fail(format!("Expected type cast, got: {:?}", self.current_token))
+        };
+        self.eat(self.current_token);
         self.eat(Token::LParen);
         let expr = self.parse_expr();
         self.eat(Token::RParen);
-        ASTNode::TypeCast(type_name, Box::new(expr))
+        self.add(ASTNode::TypeCast(type_name, expr))
     }
 
 
-    fn parse_var_decl(&mut self) -> ASTNode {
+    fn parse_var_decl(&mut self) -> NodeId {
         let is_mutable = match self.current_token {
             Token::Var => true,
             Token::NoVar => false,
-            _ => panic!("Expected var or novar"),
+            _ => self.fail("Expected var or novar".to_string()),
         };
-        self.eat(self.current_token.clone());
-    
-        let name = if let Token::Identifier(ident) = self.current_token.clone() {
-            self.eat(Token::Identifier(ident.clone()));
-            ident
+        self.eat(self.current_token);
+
+        let name = if let Token::Identifier(sym) = self.current_token {
+            let name = self.name(sym).to_string();
+            self.eat(self.current_token);
+            name
         } else {
-            panic!("Expected identifier in variable declaration");
+            self.fail("Expected identifier in variable declaration".to_string());
         };
-    
-        if self.symbol_table.contains_key(&name) {
-            panic!("Variable '{}' has already been declared", name);
-        }
-    
-        self.symbol_table.insert(name.clone(), is_mutable);
-    
+
+        // declarations inside a function body always create function locals
+        let slot = if let Some(scope) = &mut self.locals {
+            if scope.symbol_table.get(&name).map_or(false, |info| info.declared) {
+                self.fail(format!("Variable '{}' has already been declared", name));
+            }
+            let slot = scope.symbol_table.get(&name).map(|info| info.slot).unwrap_or_else(|| {
+                let slot = scope.slot_names.len();
+                scope.slot_names.push(name.clone());
+                slot
+            });
+            scope.symbol_table.insert(name.clone(), SlotInfo {
+                slot,
+                declared: true,
+                is_mutable,
+            });
+            Slot::Local(slot)
+        } else {
+            if self.symbol_table.get(&name).map_or(false, |info| info.declared) {
+                self.fail(format!("Variable '{}' has already been declared", name));
+            }
+            let slot = self.resolve_slot(&name);
+            let info = self.symbol_table.get_mut(&name).unwrap();
+            info.declared = true;
+            info.is_mutable = is_mutable;
+            slot
+        };
+
         let initializer = if self.current_token == Token::Assign {
             self.eat(Token::Assign);
-            Some(Box::new(self.parse_expr()))
+            Some(self.parse_expr())
         } else {
             None
         };
-    
+
         self.eat(Token::Semicolon);
-        ASTNode::Var(name, initializer, is_mutable)
+        self.add(ASTNode::Var(slot, initializer, is_mutable))
     }
 
-    fn parse_assign_stmt(&mut self) -> ASTNode {
-        let name = if let Token::Identifier(ident) = self.current_token.clone() {
-            self.eat(Token::Identifier(ident.clone()));
-            ident
+    fn parse_assign_stmt(&mut self) -> NodeId {
+        let name = if let Token::Identifier(sym) = self.current_token {
+            let name = self.name(sym).to_string();
+            self.eat(self.current_token);
+            name
         } else {
-            panic!("Expected identifier in assignment, got: {:?}", self.current_token);
+            self.fail(format!(
+                "Expected identifier in assignment, got: {:?}",
+                self.current_token
+            ));
         };
 
+        // a statement can also be a bare call evaluated for its side effects
+        if self.current_token == Token::LParen {
+            let call = self.parse_call(&name);
+            if self.current_token == Token::Semicolon {
+                self.eat(Token::Semicolon);
+            }
+            return call;
+        }
+
+        // or an element write: name[index] = expr;
+        if self.current_token == Token::LBracket {
+            let slot = self.resolve_slot(&name);
+            let mut target = self.add(ASTNode::Identifier(slot));
+            self.eat(Token::LBracket);
+            let mut index = self.parse_expr();
+            self.eat(Token::RBracket);
+            // all but the last index are reads: a[i][j] = x writes into a[i]
+            while self.current_token == Token::LBracket {
+                target = self.add(ASTNode::Index(target, index));
+                self.eat(Token::LBracket);
+                index = self.parse_expr();
+                self.eat(Token::RBracket);
+            }
+            self.eat(Token::Assign);
+            let value = self.parse_expr();
+            if self.current_token == Token::Semicolon {
+                self.eat(Token::Semicolon);
+            }
+            return self.add(ASTNode::IndexAssign(target, index, value));
+        }
+
         self.eat(Token::Assign);
         let expr = self.parse_expr();
-        
+
 
         if self.current_token == Token::Semicolon {
             self.eat(Token::Semicolon);
         }
-        
-        ASTNode::Assign(name, Box::new(expr))
+
+        let slot = self.resolve_slot(&name);
+        self.add(ASTNode::Assign(slot, expr))
     }
 
-    fn parse_print(&mut self) -> ASTNode {
+    fn parse_print(&mut self) -> NodeId {
         self.eat(Token::Print);
         self.eat(Token::LParen);
         let expr = self.parse_expr();
         self.eat(Token::RParen);
         self.eat(Token::Semicolon);
-        ASTNode::Print(Box::new(expr))
+        self.add(ASTNode::Print(expr))
     }
-}
\ No newline at end of file
+}
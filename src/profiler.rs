@@ -0,0 +1,163 @@
+use crate::compiler::{Chunk, Instruction};
+use crate::parser::Slot;
+use std::collections::HashMap;
+use std::time::Instant;
+
+// execution profile for --profile mode. the only cost on the hot path is one
+// array increment per executed instruction; everything in the report - opcode
+// totals, loop iteration counts, per-loop instruction shares - is derived from
+// the per-pc counters after the run. loops are recovered from the bytecode as
+// backward jumps, and described by the variables their bodies touch since the
+// ast carries no source line numbers.
+pub struct Profiler {
+    pub pc_counts: Vec<u64>,
+    start: Instant,
+}
+
+impl Profiler {
+    pub fn new(code_len: usize) -> Self {
+        Profiler {
+            pc_counts: vec![0; code_len],
+            start: Instant::now(),
+        }
+    }
+
+    pub fn report(&self, chunk: &Chunk) {
+        let elapsed = self.start.elapsed();
+        let total: u64 = self.pc_counts.iter().sum();
+        eprintln!("--- profile ---");
+        eprintln!(
+            "{} instructions in {:.3}ms",
+            total,
+            elapsed.as_secs_f64() * 1000.0
+        );
+        if total == 0 {
+            return;
+        }
+
+        // backward jumps mark loops: the jump target is the loop header and
+        // the jump site closes the body. group multiple back-edges (continue
+        // statements share the target) under one loop per header.
+        let mut loops: HashMap<usize, (usize, u64)> = HashMap::new(); // header -> (end, iterations)
+        for (pc, instruction) in chunk.code.iter().enumerate() {
+            if let Instruction::Jump(target) = instruction {
+                if *target <= pc {
+                    let entry = loops.entry(*target).or_insert((pc, 0));
+                    entry.0 = entry.0.max(pc);
+                    entry.1 += self.pc_counts[pc];
+                }
+            }
+        }
+        let mut ranked: Vec<(usize, usize, u64, u64)> = loops
+            .into_iter()
+            .map(|(header, (end, iterations))| {
+                let body: u64 = self.pc_counts[header..=end].iter().sum();
+                (header, end, iterations, body)
+            })
+            .collect();
+        ranked.sort_by(|a, b| b.3.cmp(&a.3));
+
+        if !ranked.is_empty() {
+            eprintln!("hot loops:");
+            for (header, end, iterations, body) in &ranked {
+                let mut vars: Vec<&str> = Vec::new();
+                for instruction in &chunk.code[*header..=*end] {
+                    let slot = match instruction {
+                        Instruction::Load(slot) | Instruction::Store(slot) => Some(*slot),
+                        Instruction::CmpJump(_, Slot::Global(slot), _, _)
+                        | Instruction::UpdateSlot(_, Slot::Global(slot), _) => Some(*slot),
+                        _ => None,
+                    };
+                    if let Some(slot) = slot {
+                        let name = chunk.slot_names[slot].as_str();
+                        if !vars.contains(&name) {
+                            vars.push(name);
+                        }
+                    }
+                }
+                eprintln!(
+                    "  loop at pc {}..{} (vars: {}): {} iterations, {} instructions ({:.1}%)",
+                    header,
+                    end,
+                    vars.join(", "),
+                    iterations,
+                    body,
+                    *body as f64 * 100.0 / total as f64
+                );
+            }
+        }
+
+        let mut by_kind: HashMap<String, u64> = HashMap::new();
+        for (pc, count) in self.pc_counts.iter().enumerate() {
+            if *count > 0 {
+                *by_kind.entry(describe(&chunk.code[pc], chunk)).or_insert(0) += count;
+            }
+        }
+        let mut kinds: Vec<(String, u64)> = by_kind.into_iter().collect();
+        kinds.sort_by(|a, b| b.1.cmp(&a.1));
+
+        eprintln!("top instructions:");
+        for (name, count) in kinds.iter().take(10) {
+            eprintln!(
+                "  {:<24} {:>10} ({:.1}%)",
+                name,
+                count,
+                *count as f64 * 100.0 / total as f64
+            );
+        }
+    }
+}
+
+fn slot_label(slot: &Slot, chunk: &Chunk) -> String {
+    match slot {
+        Slot::Global(s) => chunk.slot_names[*s].clone(),
+        Slot::Local(s) => format!("local {}", s),
+    }
+}
+
+fn describe(instruction: &Instruction, chunk: &Chunk) -> String {
+    match instruction {
+        Instruction::Const(_) => "Const".to_string(),
+        Instruction::Load(slot) => format!("Load({})", chunk.slot_names[*slot]),
+        Instruction::Store(slot) => format!("Store({})", chunk.slot_names[*slot]),
+        Instruction::Declare(..) => "Declare".to_string(),
+        Instruction::LoadLocal(slot) => format!("LoadLocal({})", slot),
+        Instruction::StoreLocal(slot) => format!("StoreLocal({})", slot),
+        Instruction::DeclareLocal(..) => "Declare".to_string(),
+        Instruction::Call(func) => format!("Call({})", chunk.functions[*func].name),
+        Instruction::Return => "Return".to_string(),
+        Instruction::Halt => "Halt".to_string(),
+        Instruction::Binary(op)
+        | Instruction::BinaryII(op)
+        | Instruction::BinaryFF(op) => format!("Binary({:?})", op),
+        Instruction::Not => "Not".to_string(),
+        Instruction::Print => "Print".to_string(),
+        Instruction::TypeOf => "TypeOf".to_string(),
+        Instruction::Cast(type_name) => format!("Cast({})", type_name),
+        Instruction::Index => "Index".to_string(),
+        Instruction::StoreIndex => "StoreIndex".to_string(),
+        Instruction::MakeArray(_) => "MakeArray".to_string(),
+        Instruction::Len => "Len".to_string(),
+        Instruction::Append => "Append".to_string(),
+        Instruction::Substring => "Substring".to_string(),
+        Instruction::Join => "Join".to_string(),
+        Instruction::Pad(left) => if *left { "LPad" } else { "RPad" }.to_string(),
+        Instruction::ReadLine(_) => "ReadLine".to_string(),
+        Instruction::WriteFile => "WriteFile".to_string(),
+        // the report works off the original chunk, so the quickened forms
+        // only show up here if a caller ever profiles a vm-rewritten copy
+        Instruction::CmpJump(_, slot, _, _)
+        | Instruction::CmpJumpII(_, slot, _, _)
+        | Instruction::CmpJumpFF(_, slot, _, _) => format!("CmpJump({})", slot_label(slot, chunk)),
+        Instruction::UpdateSlot(_, slot, _)
+        | Instruction::UpdateSlotII(_, slot, _)
+        | Instruction::UpdateSlotFF(_, slot, _) => format!("UpdateSlot({})", slot_label(slot, chunk)),
+        Instruction::ParallelFor(_) => "ParallelFor".to_string(),
+        Instruction::Pop => "Pop".to_string(),
+        Instruction::Jump(_)
+        | Instruction::JumpIfNotTrue(_)
+        | Instruction::JumpIfFalse(_)
+        | Instruction::JumpIfFalsePeek(_)
+        | Instruction::JumpIfTruePeek(_) => "Jump".to_string(),
+    }
+}
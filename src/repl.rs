@@ -0,0 +1,72 @@
+use crate::error;
+use crate::interpreter::Session;
+use crate::optimizer;
+use crate::parser::{Parser, SymbolState};
+use std::io::{self, BufRead, Write};
+
+// interactive mode: one parser symbol state and one vm frame live for the
+// whole session, so each snippet only pays for its own statements and can see
+// every variable declared before it.
+pub fn run(is_verbose: bool, no_opt: bool) {
+    let mut state = SymbolState::default();
+    let mut session = Session::new(is_verbose, false);
+
+    let stdin = io::stdin();
+    let mut input = String::new();
+
+    println!("Tidal repl - type 'exit' to leave");
+    loop {
+        if input.is_empty() {
+            print!("td> ");
+        } else {
+            print!("..> ");
+        }
+        io::stdout().flush().unwrap();
+
+        let mut line = String::new();
+        if stdin.lock().read_line(&mut line).unwrap_or(0) == 0 {
+            break; // EOF
+        }
+        if input.is_empty() && matches!(line.trim(), "exit" | "quit") {
+            break;
+        }
+        input.push_str(&line);
+
+        // keep reading while a block is still open (a rough count is fine for
+        // interactive use; braces in string literals will just read one more line)
+        let opens = input.matches('{').count();
+        let closes = input.matches('}').count();
+        if opens > closes {
+            continue;
+        }
+        if input.trim().is_empty() {
+            input.clear();
+            continue;
+        }
+
+        // the pipeline unwinds on errors, so run it guarded and roll the
+        // symbol state back if the snippet didn't make it through
+        let source = std::mem::take(&mut input);
+        let attempt_state = state.clone();
+        let parsed = error::catch(|| {
+            let mut parser = Parser::with_state(&source, attempt_state);
+            let program = parser.parse();
+            let program = if no_opt { program } else { optimizer::optimize(program) };
+            let slot_names = parser.slots();
+            (parser.into_state(), program, slot_names)
+        });
+
+        match parsed {
+            Ok((new_state, program, slot_names)) => {
+                state = new_state;
+                if let Err(e) = error::catch(|| session.run(&program, slot_names)) {
+                    eprintln!("Error: {}", e);
+                }
+                // the arena and function definitions outlive the snippet, so
+                // later inputs can call functions defined in this one
+                state.adopt(program);
+            }
+            Err(e) => eprintln!("Error: {}", e),
+        }
+    }
+}
@@ -0,0 +1,1338 @@
+use crate::cache;
+use crate::compiler::{Chunk, Instruction, Operand, ParallelLoop};
+use crate::lexer::Token;
+use crate::parser::{Slot, Value};
+use crate::profiler::Profiler;
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::fs;
+use std::io::{self, BufRead, Write};
+use std::rc::Rc;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::thread;
+
+// per-string indexing support, built on first index and O(1) afterwards:
+// ascii strings are indexed directly by byte, everything else through a
+// precomputed char -> byte-offset table. the cache is keyed by the Rc's
+// address and holds a clone of the Rc, which both keeps the key valid and
+// pins the refcount above one so the in-place append fast path in binary_op
+// can never mutate a string that has offsets on record.
+enum StrIndex {
+    Ascii,
+    Offsets(Vec<usize>),
+}
+
+type StrIndexCache = HashMap<usize, (Rc<String>, StrIndex)>;
+
+fn str_index<'c>(cache: &'c mut StrIndexCache, s: &Rc<String>) -> &'c StrIndex {
+    let key = Rc::as_ptr(s) as usize;
+    &cache
+        .entry(key)
+        .or_insert_with(|| {
+            let index = if s.is_ascii() {
+                StrIndex::Ascii
+            } else {
+                StrIndex::Offsets(s.char_indices().map(|(offset, _)| offset).collect())
+            };
+            (s.clone(), index)
+        })
+        .1
+}
+
+// loop-based vm with an explicit value stack, so hot loops re-dispatch on a
+// single flat instruction stream instead of re-walking the ast every iteration.
+// variables live in a flat frame indexed by the slots the parser assigned, so
+// access is an array index instead of hashing the name on every use.
+// the frame is caller-owned so a repl session can keep its variables alive
+// from one input to the next; one-shot runs just pass a fresh Vec.
+// print goes through the caller's writer (normally buffered, flushed by the
+// session) instead of locking and flushing stdout once per line; the verbose
+// trace goes straight to stderr so it can never interleave with data output
+pub fn run_with_frame(
+    chunk: &Chunk,
+    frame: &mut Vec<Option<(Value, bool)>>,
+    out: &mut dyn Write,
+    is_verbose: bool,
+    mut profile: Option<&mut Profiler>,
+) -> Value {
+    let mut stack: Vec<Value> = Vec::new();
+    if frame.len() < chunk.slot_names.len() {
+        frame.resize(chunk.slot_names.len(), None); // (Value, is_mutable)
+    }
+    // function call frames are contiguous runs of this one vec; each call
+    // record holds (return pc, frame base, function index)
+    let mut locals: Vec<Option<(Value, bool)>> = Vec::new();
+    let mut calls: Vec<(usize, usize, usize)> = Vec::new();
+    let mut str_cache: StrIndexCache = HashMap::new();
+    // per-run pools for transient strings: single-char indexing results and
+    // the scratch buffer array printing formats into (cleared, not freed,
+    // after every use)
+    let mut char_pool: Vec<Option<Rc<String>>> = vec![None; 128];
+    let mut print_buf = String::new();
+    // per-run file handles for the line i/o builtins: one buffered reader
+    // per path readline() has seen (so repeated calls stream through the
+    // file), one buffered writer per path write() has seen (created fresh,
+    // so each run starts its output files over). writers are flushed at
+    // halt, and by drop if the run unwinds early.
+    let mut line_readers: HashMap<String, io::BufReader<fs::File>> = HashMap::new();
+    let mut stdin_reader: Option<io::StdinLock<'static>> = None;
+    let mut line_writers: HashMap<String, io::BufWriter<fs::File>> = HashMap::new();
+    let mut pc = 0;
+
+    // the vm executes its own copy of the code so hot loops can be rewritten
+    // (quickened) in place without touching the caller's chunk; instruction
+    // indices never change, so the profiler counters still line up
+    let mut code: Vec<Instruction> = chunk.code.clone();
+    let mut back_edges: Vec<u32> = vec![0; code.len()];
+
+    while pc < code.len() {
+        if let Some(p) = profile.as_deref_mut() {
+            p.pc_counts[pc] += 1;
+        }
+        match &code[pc] {
+            Instruction::Const(idx) => {
+                stack.push(chunk.constants[*idx].clone());
+            }
+            Instruction::Load(slot) => {
+                if let Some((value, _)) = &frame[*slot] {
+                    stack.push(value.clone());
+                } else {
+                    panic!("Variable not found: {}", chunk.slot_names[*slot]);
+                }
+            }
+            Instruction::Store(slot) => {
+                let value = stack.pop().unwrap();
+                if let Some((_, is_mutable)) = &frame[*slot] {
+                    if !is_mutable {
+                        panic!("Cannot assign to immutable variable: {}", chunk.slot_names[*slot]);
+                    }
+                    if is_verbose {
+                        eprintln!("assign {} = {:?}", chunk.slot_names[*slot], value);
+                    }
+                    frame[*slot] = Some((value, true));
+                } else {
+                    panic!("Variable not declared: {}", chunk.slot_names[*slot]);
+                }
+            }
+            Instruction::Declare(slot, is_mutable) => {
+                let value = stack.pop().unwrap();
+                if is_verbose {
+                    eprintln!("declare variable {} with {:?}", chunk.slot_names[*slot], value);
+                }
+                frame[*slot] = Some((value, *is_mutable));
+            }
+            Instruction::LoadLocal(slot) => {
+                let &(_, base, func) = calls.last().unwrap();
+                if let Some((value, _)) = &locals[base + *slot] {
+                    stack.push(value.clone());
+                } else {
+                    panic!("Variable not found: {}", chunk.functions[func].local_names[*slot]);
+                }
+            }
+            Instruction::StoreLocal(slot) => {
+                let value = stack.pop().unwrap();
+                let &(_, base, func) = calls.last().unwrap();
+                if let Some((_, is_mutable)) = &locals[base + *slot] {
+                    if !is_mutable {
+                        panic!(
+                            "Cannot assign to immutable variable: {}",
+                            chunk.functions[func].local_names[*slot]
+                        );
+                    }
+                    if is_verbose {
+                        eprintln!("assign {} = {:?}", chunk.functions[func].local_names[*slot], value);
+                    }
+                    locals[base + *slot] = Some((value, true));
+                } else {
+                    panic!("Variable not declared: {}", chunk.functions[func].local_names[*slot]);
+                }
+            }
+            Instruction::DeclareLocal(slot, is_mutable) => {
+                let value = stack.pop().unwrap();
+                let &(_, base, func) = calls.last().unwrap();
+                if is_verbose {
+                    eprintln!(
+                        "declare variable {} with {:?}",
+                        chunk.functions[func].local_names[*slot], value
+                    );
+                }
+                locals[base + *slot] = Some((value, *is_mutable));
+            }
+            Instruction::Binary(op) => {
+                let op = *op;
+                let right = stack.pop().unwrap();
+                let left = stack.pop().unwrap();
+                // remember the operand pair this site just saw: the next
+                // execution jumps straight to the matching kernel instead
+                // of re-matching the whole type cross-product. only the
+                // numeric pairs are cached; strings stay on this arm for
+                // the in-place append below
+                match (&left, &right) {
+                    (Value::Number(_), Value::Number(_)) => {
+                        code[pc] = Instruction::BinaryII(op);
+                    }
+                    (Value::Float(_), Value::Float(_)) => {
+                        code[pc] = Instruction::BinaryFF(op);
+                    }
+                    _ => {}
+                }
+                // `s = s + t` loads a second handle on s, so the in-place
+                // append below would never fire and every iteration would
+                // recopy the whole string, making build-a-report loops O(n²)
+                // in total bytes. when the very next instruction stores the
+                // result straight back into the slot the left operand came
+                // from, drop the slot's handle first: the append then owns
+                // the only reference and is amortized O(1).
+                if matches!(op, Token::Plus) {
+                    if let Value::String(s) = &left {
+                        if Rc::strong_count(s) == 2 {
+                            match code.get(pc + 1) {
+                                Some(Instruction::Store(slot)) => {
+                                    if let Some((Value::String(held), true)) = &frame[*slot] {
+                                        if Rc::ptr_eq(s, held) {
+                                            frame[*slot] = Some((Value::Null, true));
+                                        }
+                                    }
+                                }
+                                Some(Instruction::StoreLocal(slot)) => {
+                                    let &(_, base, _) = calls.last().unwrap();
+                                    if let Some((Value::String(held), true)) = &locals[base + *slot] {
+                                        if Rc::ptr_eq(s, held) {
+                                            locals[base + *slot] = Some((Value::Null, true));
+                                        }
+                                    }
+                                }
+                                _ => {}
+                            }
+                        }
+                    }
+                }
+                stack.push(binary_op(left, &op, right));
+            }
+            // inline-cached numeric kernels; the full binary_op handles a
+            // site the moment its operand types change, after restoring the
+            // generic instruction so the cache re-trains on the new pair
+            Instruction::BinaryII(op) => {
+                let op = *op;
+                match (stack.pop().unwrap(), stack.pop().unwrap()) {
+                    (Value::Number(r), Value::Number(l)) => stack.push(number_op(l, &op, r)),
+                    (right, left) => {
+                        code[pc] = Instruction::Binary(op);
+                        stack.push(binary_op(left, &op, right));
+                    }
+                }
+            }
+            Instruction::BinaryFF(op) => {
+                let op = *op;
+                match (stack.pop().unwrap(), stack.pop().unwrap()) {
+                    (Value::Float(r), Value::Float(l)) => stack.push(float_op(l, &op, r)),
+                    (right, left) => {
+                        code[pc] = Instruction::Binary(op);
+                        stack.push(binary_op(left, &op, right));
+                    }
+                }
+            }
+            Instruction::Not => {
+                let value = stack.pop().unwrap();
+                match value {
+                    Value::Boolean(b) => stack.push(Value::Boolean(!b)),
+                    _ => panic!("Unsupported unary operation"),
+                }
+            }
+            Instruction::Print => {
+                let value = stack.pop().unwrap();
+                if is_verbose {
+                    eprintln!("call print({:?})", value);
+                } else {
+                    let written = match value {
+                        Value::Number(n) => writeln!(out, "{}", n),
+                        Value::String(s) => writeln!(out, "{}", s),
+                        Value::Boolean(b) => writeln!(out, "{}", b),
+                        Value::Float(f) => writeln!(out, "{}", f),
+                        Value::Null => writeln!(out, "null"),
+                        Value::Type(t) => writeln!(out, "{}", t),
+                        Value::Array(_) => {
+                            print_buf.clear();
+                            display_into(&mut print_buf, &value);
+                            writeln!(out, "{}", print_buf)
+                        }
+                    };
+                    written.expect("Something went wrong writing output");
+                }
+            }
+            Instruction::TypeOf => {
+                let value = stack.pop().unwrap();
+                let type_str = match value {
+                    Value::Number(_) => "int",
+                    Value::String(_) => "str",
+                    Value::Boolean(_) => "bool",
+                    Value::Float(_) => "float",
+                    Value::Null => "null",
+                    Value::Type(_) => "type",
+                    Value::Array(_) => "array",
+                };
+                if is_verbose {
+                    eprintln!("call type({:?}) = {}", value, type_str);
+                }
+                stack.push(Value::Type(Rc::new(type_str.to_string())));
+            }
+            Instruction::Cast(type_name) => {
+                let value = stack.pop().unwrap();
+                stack.push(cast_value(type_name, value));
+            }
+            Instruction::Index => {
+                let index = stack.pop().unwrap();
+                let value = stack.pop().unwrap();
+                match (value, index) {
+                    (Value::String(s), Value::Number(i)) => {
+                        if i < 0 || i >= s.len() as i64 {
+                            panic!("Index out of bounds");
+                        }
+                        let i = i as usize;
+                        let piece = match str_index(&mut str_cache, &s) {
+                            StrIndex::Ascii => pooled_char(&mut char_pool, s.as_bytes()[i]),
+                            StrIndex::Offsets(offsets) => {
+                                if i >= offsets.len() {
+                                    panic!("Index out of bounds");
+                                }
+                                let start = offsets[i];
+                                let end = offsets.get(i + 1).copied().unwrap_or(s.len());
+                                let slice = &s[start..end];
+                                if let [byte @ 0..=127] = slice.as_bytes() {
+                                    pooled_char(&mut char_pool, *byte)
+                                } else {
+                                    Rc::new(slice.to_string())
+                                }
+                            }
+                        };
+                        stack.push(Value::String(piece));
+                    }
+                    (Value::Array(a), Value::Number(i)) => {
+                        let a = a.borrow();
+                        if i < 0 || i >= a.len() as i64 {
+                            panic!("Index out of bounds");
+                        }
+                        stack.push(a[i as usize].clone());
+                    }
+                    _ => panic!("Invalid indexing operation"),
+                }
+            }
+            Instruction::StoreIndex => {
+                let value = stack.pop().unwrap();
+                let index = stack.pop().unwrap();
+                let target = stack.pop().unwrap();
+                match (target, index) {
+                    (Value::Array(a), Value::Number(i)) => {
+                        let mut a = a.borrow_mut();
+                        if i < 0 || i >= a.len() as i64 {
+                            panic!("Index out of bounds");
+                        }
+                        a[i as usize] = value;
+                    }
+                    _ => panic!("Invalid indexing operation"),
+                }
+            }
+            Instruction::MakeArray(count) => {
+                let elements = stack.split_off(stack.len() - *count);
+                stack.push(Value::Array(Rc::new(RefCell::new(elements))));
+            }
+            Instruction::Len => {
+                let value = stack.pop().unwrap();
+                let length = match value {
+                    Value::Array(a) => a.borrow().len() as i64,
+                    Value::String(s) => s.chars().count() as i64,
+                    _ => panic!("len() requires a string or array"),
+                };
+                stack.push(Value::Number(length));
+            }
+            Instruction::Append => {
+                let value = stack.pop().unwrap();
+                match stack.pop().unwrap() {
+                    Value::Array(a) => a.borrow_mut().push(value),
+                    _ => panic!("append() requires an array"),
+                }
+            }
+            Instruction::Substring => {
+                let end = stack.pop().unwrap();
+                let start = stack.pop().unwrap();
+                let value = stack.pop().unwrap();
+                let (s, start, end) = match (value, start, end) {
+                    (Value::String(s), Value::Number(start), Value::Number(end)) => (s, start, end),
+                    _ => panic!("substring() requires a string and two int indices"),
+                };
+                if start < 0 || end < start {
+                    panic!("Index out of bounds");
+                }
+                let (start, end) = (start as usize, end as usize);
+                let piece = match str_index(&mut str_cache, &s) {
+                    StrIndex::Ascii => {
+                        if end > s.len() {
+                            panic!("Index out of bounds");
+                        }
+                        s[start..end].to_string()
+                    }
+                    StrIndex::Offsets(offsets) => {
+                        if end > offsets.len() {
+                            panic!("Index out of bounds");
+                        }
+                        let byte_start = offsets.get(start).copied().unwrap_or(s.len());
+                        let byte_end = offsets.get(end).copied().unwrap_or(s.len());
+                        s[byte_start..byte_end].to_string()
+                    }
+                };
+                stack.push(Value::String(Rc::new(piece)));
+            }
+            Instruction::Join => {
+                let separator = stack.pop().unwrap();
+                let value = stack.pop().unwrap();
+                let (array, separator) = match (value, separator) {
+                    (Value::Array(a), Value::String(s)) => (a, s),
+                    _ => panic!("join() requires an array and a string separator"),
+                };
+                let elements = array.borrow();
+                // size the buffer once: separators and string elements are
+                // exact, only non-string elements can force a grow
+                let mut capacity = separator.len() * elements.len().saturating_sub(1);
+                for element in elements.iter() {
+                    if let Value::String(s) = element {
+                        capacity += s.len();
+                    }
+                }
+                let mut joined = String::with_capacity(capacity);
+                for (i, element) in elements.iter().enumerate() {
+                    if i > 0 {
+                        joined.push_str(&separator);
+                    }
+                    match element {
+                        Value::String(s) => joined.push_str(s),
+                        other => display_into(&mut joined, other),
+                    }
+                }
+                drop(elements);
+                stack.push(Value::String(Rc::new(joined)));
+            }
+            Instruction::Pad(left) => {
+                let fill = stack.pop().unwrap();
+                let width = stack.pop().unwrap();
+                let value = stack.pop().unwrap();
+                let (s, width, fill) = match (value, width, fill) {
+                    (Value::String(s), Value::Number(w), Value::String(f)) => (s, w, f),
+                    _ => panic!("lpad()/rpad() require a string, an int width and a fill string"),
+                };
+                if fill.is_empty() {
+                    panic!("Pad fill string cannot be empty");
+                }
+                // width counts characters, like len(); a string already at
+                // width passes through without copying
+                let width = width.max(0) as usize;
+                let length = s.chars().count();
+                if length >= width {
+                    stack.push(Value::String(s));
+                } else {
+                    let missing = width - length;
+                    let mut padded = String::with_capacity(s.len() + missing);
+                    if !left {
+                        padded.push_str(&s);
+                    }
+                    // the fill pattern repeats and is cut at the boundary
+                    padded.extend(fill.chars().cycle().take(missing));
+                    if *left {
+                        padded.push_str(&s);
+                    }
+                    stack.push(Value::String(Rc::new(padded)));
+                }
+            }
+            Instruction::ReadLine(has_path) => {
+                let line = if *has_path {
+                    let path = match stack.pop().unwrap() {
+                        Value::String(s) => s,
+                        _ => panic!("readline() requires a string path"),
+                    };
+                    let reader = match line_readers.get_mut(path.as_str()) {
+                        Some(reader) => reader,
+                        None => {
+                            // reading back a file this run is writing:
+                            // push the buffered lines out first
+                            if let Some(writer) = line_writers.get_mut(path.as_str()) {
+                                writer
+                                    .flush()
+                                    .expect("Something went wrong writing output");
+                            }
+                            let file = match fs::File::open(path.as_str()) {
+                                Ok(file) => file,
+                                Err(_) => panic!("Cannot open '{}' for reading", path),
+                            };
+                            line_readers
+                                .entry((*path).clone())
+                                .or_insert(io::BufReader::new(file))
+                        }
+                    };
+                    read_line_from(reader)
+                } else {
+                    let stdin = stdin_reader.get_or_insert_with(|| io::stdin().lock());
+                    read_line_from(stdin)
+                };
+                stack.push(line);
+            }
+            Instruction::WriteFile => {
+                let value = stack.pop().unwrap();
+                let path = match stack.pop().unwrap() {
+                    Value::String(s) => s,
+                    _ => panic!("write() requires a string path"),
+                };
+                let writer = match line_writers.get_mut(path.as_str()) {
+                    Some(writer) => writer,
+                    None => {
+                        let file = match fs::File::create(path.as_str()) {
+                            Ok(file) => file,
+                            Err(_) => panic!("Cannot open '{}' for writing", path),
+                        };
+                        line_writers
+                            .entry((*path).clone())
+                            .or_insert(io::BufWriter::new(file))
+                    }
+                };
+                let written = match value {
+                    Value::String(s) => writeln!(writer, "{}", s),
+                    other => {
+                        print_buf.clear();
+                        display_into(&mut print_buf, &other);
+                        writeln!(writer, "{}", print_buf)
+                    }
+                };
+                written.expect("Something went wrong writing output");
+            }
+            Instruction::Pop => {
+                stack.pop();
+            }
+            Instruction::Jump(target) => {
+                let target = *target;
+                // a backward jump closes a loop; once one has run hot enough,
+                // specialize the body to the operand types observed right now
+                if target <= pc {
+                    back_edges[pc] += 1;
+                    if back_edges[pc] == HOT_LOOP_THRESHOLD {
+                        quicken(&mut code[target..=pc], frame, &locals, &calls, chunk);
+                    }
+                }
+                pc = target;
+                continue;
+            }
+            Instruction::JumpIfNotTrue(target) => {
+                let value = stack.pop().unwrap();
+                if !matches!(value, Value::Boolean(true)) {
+                    pc = *target;
+                    continue;
+                }
+            }
+            Instruction::JumpIfFalse(target) => {
+                let value = stack.pop().unwrap();
+                if matches!(value, Value::Boolean(false)) {
+                    pc = *target;
+                    continue;
+                }
+            }
+            Instruction::JumpIfFalsePeek(target) => {
+                if matches!(stack.last(), Some(Value::Boolean(false))) {
+                    pc = *target;
+                    continue;
+                }
+            }
+            Instruction::JumpIfTruePeek(target) => {
+                if matches!(stack.last(), Some(Value::Boolean(true))) {
+                    pc = *target;
+                    continue;
+                }
+            }
+            Instruction::Call(func) => {
+                let f = &chunk.functions[*func];
+                if calls.len() >= 10_000 {
+                    panic!("Stack overflow in function '{}'", f.name);
+                }
+                if is_verbose {
+                    eprintln!("call {}({:?})", f.name, &stack[stack.len() - f.arity..]);
+                }
+                let base = locals.len();
+                locals.resize(base + f.local_names.len(), None);
+                // arguments were pushed left to right
+                for param in (0..f.arity).rev() {
+                    locals[base + param] = Some((stack.pop().unwrap(), true));
+                }
+                calls.push((pc + 1, base, *func));
+                pc = f.start;
+                continue;
+            }
+            Instruction::Return => {
+                let value = stack.pop().unwrap();
+                let (return_pc, base, _) = calls.pop().unwrap();
+                locals.truncate(base);
+                stack.push(value);
+                pc = return_pc;
+                continue;
+            }
+            Instruction::Halt => {
+                for writer in line_writers.values_mut() {
+                    writer.flush().expect("Something went wrong writing output");
+                }
+                break;
+            }
+            Instruction::ParallelFor(loop_) => {
+                let loop_ = Rc::clone(loop_);
+                let step = stack.pop().unwrap();
+                let bound = stack.pop().unwrap();
+                run_parallel_for(&loop_, bound, step, frame, out);
+            }
+            // fused loop-header check: read, compare and branch in one
+            // dispatch with nothing pushed through the stack
+            Instruction::CmpJump(op, slot, operand, target) => {
+                let left = match slot {
+                    Slot::Global(s) => match &frame[*s] {
+                        Some((value, _)) => value.clone(),
+                        None => panic!("Variable not found: {}", chunk.slot_names[*s]),
+                    },
+                    Slot::Local(s) => {
+                        let &(_, base, func) = calls.last().unwrap();
+                        match &locals[base + *s] {
+                            Some((value, _)) => value.clone(),
+                            None => panic!(
+                                "Variable not found: {}",
+                                chunk.functions[func].local_names[*s]
+                            ),
+                        }
+                    }
+                };
+                let right = match operand {
+                    Operand::Const(idx) => chunk.constants[*idx].clone(),
+                    Operand::Slot(Slot::Global(s)) => match &frame[*s] {
+                        Some((value, _)) => value.clone(),
+                        None => panic!("Variable not found: {}", chunk.slot_names[*s]),
+                    },
+                    Operand::Slot(Slot::Local(s)) => {
+                        let &(_, base, func) = calls.last().unwrap();
+                        match &locals[base + *s] {
+                            Some((value, _)) => value.clone(),
+                            None => panic!(
+                                "Variable not found: {}",
+                                chunk.functions[func].local_names[*s]
+                            ),
+                        }
+                    }
+                };
+                if matches!(binary_op(left, op, right), Value::Boolean(false)) {
+                    pc = *target;
+                    continue;
+                }
+            }
+            // fused `i = i + 1` / `s = s + t`: the value is taken out of its
+            // slot for the operation, so it holds the only reference and a
+            // string append can reuse its buffer in place
+            Instruction::UpdateSlot(op, slot, operand) => {
+                let (left, is_mutable) = match slot {
+                    Slot::Global(s) => frame[*s]
+                        .take()
+                        .unwrap_or_else(|| panic!("Variable not found: {}", chunk.slot_names[*s])),
+                    Slot::Local(s) => {
+                        let &(_, base, func) = calls.last().unwrap();
+                        locals[base + *s].take().unwrap_or_else(|| {
+                            panic!("Variable not found: {}", chunk.functions[func].local_names[*s])
+                        })
+                    }
+                };
+                let right = match operand {
+                    Operand::Const(idx) => chunk.constants[*idx].clone(),
+                    Operand::Slot(s) if s == slot => left.clone(),
+                    Operand::Slot(Slot::Global(s)) => match &frame[*s] {
+                        Some((value, _)) => value.clone(),
+                        None => panic!("Variable not found: {}", chunk.slot_names[*s]),
+                    },
+                    Operand::Slot(Slot::Local(s)) => {
+                        let &(_, base, func) = calls.last().unwrap();
+                        match &locals[base + *s] {
+                            Some((value, _)) => value.clone(),
+                            None => panic!(
+                                "Variable not found: {}",
+                                chunk.functions[func].local_names[*s]
+                            ),
+                        }
+                    }
+                };
+                let value = binary_op(left, op, right);
+                match slot {
+                    Slot::Global(s) => {
+                        if !is_mutable {
+                            panic!(
+                                "Cannot assign to immutable variable: {}",
+                                chunk.slot_names[*s]
+                            );
+                        }
+                        if is_verbose {
+                            eprintln!("assign {} = {:?}", chunk.slot_names[*s], value);
+                        }
+                        frame[*s] = Some((value, true));
+                    }
+                    Slot::Local(s) => {
+                        let &(_, base, func) = calls.last().unwrap();
+                        if !is_mutable {
+                            panic!(
+                                "Cannot assign to immutable variable: {}",
+                                chunk.functions[func].local_names[*s]
+                            );
+                        }
+                        if is_verbose {
+                            eprintln!(
+                                "assign {} = {:?}",
+                                chunk.functions[func].local_names[*s], value
+                            );
+                        }
+                        locals[base + *s] = Some((value, true));
+                    }
+                }
+            }
+            // quickened forms: both operands were integers (or floats) when
+            // the loop got hot. verify cheaply, run on the primitives, and
+            // deopt back to the generic instruction the moment a type changed
+            Instruction::CmpJumpII(op, slot, operand, target) => {
+                let (op, slot, operand, target) = (*op, *slot, *operand, *target);
+                let left = match slot_entry(&slot, frame, &locals, &calls) {
+                    Some((Value::Number(n), _)) => Some(*n),
+                    _ => None,
+                };
+                let right = match operand_value(&operand, frame, &locals, &calls, chunk) {
+                    Some(Value::Number(n)) => Some(*n),
+                    _ => None,
+                };
+                let (Some(left), Some(right)) = (left, right) else {
+                    code[pc] = Instruction::CmpJump(op, slot, operand, target);
+                    continue;
+                };
+                if matches!(number_op(left, &op, right), Value::Boolean(false)) {
+                    pc = target;
+                    continue;
+                }
+            }
+            Instruction::CmpJumpFF(op, slot, operand, target) => {
+                let (op, slot, operand, target) = (*op, *slot, *operand, *target);
+                let left = match slot_entry(&slot, frame, &locals, &calls) {
+                    Some((Value::Float(x), _)) => Some(*x),
+                    _ => None,
+                };
+                let right = match operand_value(&operand, frame, &locals, &calls, chunk) {
+                    Some(Value::Float(x)) => Some(*x),
+                    _ => None,
+                };
+                let (Some(left), Some(right)) = (left, right) else {
+                    code[pc] = Instruction::CmpJump(op, slot, operand, target);
+                    continue;
+                };
+                if matches!(float_op(left, &op, right), Value::Boolean(false)) {
+                    pc = target;
+                    continue;
+                }
+            }
+            Instruction::UpdateSlotII(op, slot, operand) => {
+                let (op, slot, operand) = (*op, *slot, *operand);
+                let left = match slot_entry(&slot, frame, &locals, &calls) {
+                    Some((Value::Number(n), true)) => Some(*n),
+                    _ => None,
+                };
+                let right = match operand_value(&operand, frame, &locals, &calls, chunk) {
+                    Some(Value::Number(n)) => Some(*n),
+                    _ => None,
+                };
+                let (Some(left), Some(right)) = (left, right) else {
+                    code[pc] = Instruction::UpdateSlot(op, slot, operand);
+                    continue;
+                };
+                let value = number_op(left, &op, right);
+                write_slot(&slot, value, frame, &mut locals, &calls, chunk, is_verbose);
+            }
+            Instruction::UpdateSlotFF(op, slot, operand) => {
+                let (op, slot, operand) = (*op, *slot, *operand);
+                let left = match slot_entry(&slot, frame, &locals, &calls) {
+                    Some((Value::Float(x), true)) => Some(*x),
+                    _ => None,
+                };
+                let right = match operand_value(&operand, frame, &locals, &calls, chunk) {
+                    Some(Value::Float(x)) => Some(*x),
+                    _ => None,
+                };
+                let (Some(left), Some(right)) = (left, right) else {
+                    code[pc] = Instruction::UpdateSlot(op, slot, operand);
+                    continue;
+                };
+                let value = float_op(left, &op, right);
+                write_slot(&slot, value, frame, &mut locals, &calls, chunk, is_verbose);
+            }
+        }
+        pc += 1;
+    }
+
+    Value::Null
+}
+
+// threshold of back-edge crossings after which a loop body is specialized
+const HOT_LOOP_THRESHOLD: u32 = 128;
+
+// rewrite a hot loop body to the instruction forms matching the operand
+// types observable right now. a wrong or stale guess deopts on its first
+// execution, so this is only ever a hint, never a semantic change.
+fn quicken(
+    body: &mut [Instruction],
+    frame: &[Option<(Value, bool)>],
+    locals: &[Option<(Value, bool)>],
+    calls: &[(usize, usize, usize)],
+    chunk: &Chunk,
+) {
+    for instruction in body.iter_mut() {
+        let specialized = match instruction {
+            Instruction::CmpJump(op, slot, operand, target) => {
+                let left = slot_entry(slot, frame, locals, calls).map(|(value, _)| value);
+                let right = operand_value(operand, frame, locals, calls, chunk);
+                match (left, right) {
+                    (Some(Value::Number(_)), Some(Value::Number(_))) => {
+                        Some(Instruction::CmpJumpII(*op, *slot, *operand, *target))
+                    }
+                    (Some(Value::Float(_)), Some(Value::Float(_))) => {
+                        Some(Instruction::CmpJumpFF(*op, *slot, *operand, *target))
+                    }
+                    _ => None,
+                }
+            }
+            Instruction::UpdateSlot(op, slot, operand) => {
+                let left = slot_entry(slot, frame, locals, calls).map(|(value, _)| value);
+                let right = operand_value(operand, frame, locals, calls, chunk);
+                match (left, right) {
+                    (Some(Value::Number(_)), Some(Value::Number(_))) => {
+                        Some(Instruction::UpdateSlotII(*op, *slot, *operand))
+                    }
+                    (Some(Value::Float(_)), Some(Value::Float(_))) => {
+                        Some(Instruction::UpdateSlotFF(*op, *slot, *operand))
+                    }
+                    _ => None,
+                }
+            }
+            _ => None,
+        };
+        if let Some(specialized) = specialized {
+            *instruction = specialized;
+        }
+    }
+}
+
+// current (value, mutability) entry of a variable, if it has one
+fn slot_entry<'v>(
+    slot: &Slot,
+    frame: &'v [Option<(Value, bool)>],
+    locals: &'v [Option<(Value, bool)>],
+    calls: &[(usize, usize, usize)],
+) -> Option<&'v (Value, bool)> {
+    match slot {
+        Slot::Global(s) => frame[*s].as_ref(),
+        Slot::Local(s) => {
+            let &(_, base, _) = calls.last().unwrap();
+            locals[base + *s].as_ref()
+        }
+    }
+}
+
+fn operand_value<'v>(
+    operand: &Operand,
+    frame: &'v [Option<(Value, bool)>],
+    locals: &'v [Option<(Value, bool)>],
+    calls: &[(usize, usize, usize)],
+    chunk: &'v Chunk,
+) -> Option<&'v Value> {
+    match operand {
+        Operand::Const(idx) => Some(&chunk.constants[*idx]),
+        Operand::Slot(slot) => slot_entry(slot, frame, locals, calls).map(|(value, _)| value),
+    }
+}
+
+// store a quickened result; declaration and mutability were already verified
+// by the generic instruction executions that made the loop hot
+fn write_slot(
+    slot: &Slot,
+    value: Value,
+    frame: &mut [Option<(Value, bool)>],
+    locals: &mut [Option<(Value, bool)>],
+    calls: &[(usize, usize, usize)],
+    chunk: &Chunk,
+    is_verbose: bool,
+) {
+    match slot {
+        Slot::Global(s) => {
+            if is_verbose {
+                eprintln!("assign {} = {:?}", chunk.slot_names[*s], value);
+            }
+            frame[*s] = Some((value, true));
+        }
+        Slot::Local(s) => {
+            let &(_, base, func) = calls.last().unwrap();
+            if is_verbose {
+                eprintln!("assign {} = {:?}", chunk.functions[func].local_names[*s], value);
+            }
+            locals[base + *s] = Some((value, true));
+        }
+    }
+}
+
+// integer '**': negative exponents drop to a float result (the integer one
+// would almost always be zero), everything else is overflow-checked
+// a deep, Rc-free copy of a Value: Value itself cannot cross a thread
+// boundary, so the per-iteration snapshot of outer variables travels in this
+// form and each worker rebuilds real Values on its own side
+enum PlainValue {
+    Number(i64),
+    Float(f64),
+    Boolean(bool),
+    Null,
+    Str(String),
+    Type(String),
+    Array(Vec<PlainValue>),
+}
+
+impl PlainValue {
+    fn of(value: &Value) -> PlainValue {
+        match value {
+            Value::Number(n) => PlainValue::Number(*n),
+            Value::Float(f) => PlainValue::Float(*f),
+            Value::Boolean(b) => PlainValue::Boolean(*b),
+            Value::Null => PlainValue::Null,
+            Value::String(s) => PlainValue::Str(s.as_ref().clone()),
+            Value::Type(t) => PlainValue::Type(t.as_ref().clone()),
+            Value::Array(elements) => {
+                PlainValue::Array(elements.borrow().iter().map(PlainValue::of).collect())
+            }
+        }
+    }
+
+    fn to_value(&self) -> Value {
+        match self {
+            PlainValue::Number(n) => Value::Number(*n),
+            PlainValue::Float(f) => Value::Float(*f),
+            PlainValue::Boolean(b) => Value::Boolean(*b),
+            PlainValue::Null => Value::Null,
+            PlainValue::Str(s) => Value::String(Rc::new(s.clone())),
+            PlainValue::Type(t) => Value::Type(Rc::new(t.clone())),
+            PlainValue::Array(elements) => Value::Array(Rc::new(RefCell::new(
+                elements.iter().map(PlainValue::to_value).collect(),
+            ))),
+        }
+    }
+}
+
+// `parallel for`: enumerate the iteration values sequentially (the compiler
+// guaranteed the canonical counted form), then run the body once per value
+// across a worker pool. the compile-time check proved each iteration writes
+// only its own variables, so workers share nothing: every iteration gets a
+// private frame holding its loop value plus deep copies of the outer
+// variables the body reads, and the body chunk itself crosses the thread
+// boundary through the cache byte encoding since Value holds Rc. per-
+// iteration print output is buffered and replayed in iteration order, the
+// same scheme batch mode uses for whole files.
+fn run_parallel_for(
+    loop_: &ParallelLoop,
+    bound: Value,
+    step: Value,
+    frame: &mut [Option<(Value, bool)>],
+    out: &mut dyn Write,
+) {
+    let start = match &frame[loop_.var] {
+        Some((Value::Number(n), _)) => *n,
+        _ => panic!("parallel for requires integer bounds"),
+    };
+    let (Value::Number(bound), Value::Number(step)) = (bound, step) else {
+        panic!("parallel for requires integer bounds");
+    };
+
+    let mut values = Vec::new();
+    let mut i = start;
+    while matches!(number_op(i, &loop_.op, bound), Value::Boolean(true)) {
+        values.push(i);
+        i = match number_op(i, &loop_.step_op, step) {
+            Value::Number(n) => n,
+            other => unreachable!("integer update produced {:?}", other),
+        };
+    }
+    // the loop variable ends up one step past the bound, like sequential for
+    frame[loop_.var] = Some((Value::Number(i), true));
+    if values.is_empty() {
+        return;
+    }
+
+    let snapshot: Vec<(usize, bool, PlainValue)> = loop_
+        .snapshot
+        .iter()
+        .filter_map(|&slot| {
+            frame[slot]
+                .as_ref()
+                .map(|(value, is_mutable)| (slot, *is_mutable, PlainValue::of(value)))
+        })
+        .collect();
+    let width = loop_.body.slot_names.len();
+    // captures only thread-safe data (the snapshot is Rc-free), so the
+    // workers below can all call it
+    let var = loop_.var;
+    let iteration_frame = move |value: i64| {
+        let mut frame: Vec<Option<(Value, bool)>> = vec![None; width];
+        frame[var] = Some((Value::Number(value), true));
+        for (slot, is_mutable, plain) in &snapshot {
+            frame[*slot] = Some((plain.to_value(), *is_mutable));
+        }
+        frame
+    };
+
+    // one worker per core unless TD_PARALLEL_WORKERS says otherwise (the
+    // same knob --jobs is for batch mode, but there is no flag to thread
+    // through to an arbitrary instruction)
+    let workers = std::env::var("TD_PARALLEL_WORKERS")
+        .ok()
+        .and_then(|n| n.parse::<usize>().ok())
+        .filter(|&n| n > 0)
+        .unwrap_or_else(|| thread::available_parallelism().map(|n| n.get()).unwrap_or(1))
+        .min(values.len());
+    if workers <= 1 {
+        for &value in &values {
+            run_with_frame(&loop_.body, &mut iteration_frame(value), out, false, None);
+        }
+        return;
+    }
+
+    let encoded = cache::encode(&loop_.body);
+    let next = AtomicUsize::new(0);
+    let outputs: Vec<Mutex<Vec<u8>>> = values.iter().map(|_| Mutex::new(Vec::new())).collect();
+    thread::scope(|scope| {
+        let handles: Vec<_> = (0..workers)
+            .map(|_| {
+                scope.spawn(|| {
+                    // each worker decodes its own private copy of the body once
+                    let body = cache::decode(&encoded).expect("parallel body failed to decode");
+                    loop {
+                        let index = next.fetch_add(1, Ordering::Relaxed);
+                        if index >= values.len() {
+                            break;
+                        }
+                        let mut buffer = outputs[index].lock().unwrap();
+                        run_with_frame(
+                            &body,
+                            &mut iteration_frame(values[index]),
+                            &mut *buffer,
+                            false,
+                            None,
+                        );
+                    }
+                })
+            })
+            .collect();
+        // join by hand so a failing iteration surfaces its own error message
+        // instead of scope's generic "a scoped thread panicked"
+        for handle in handles {
+            if let Err(payload) = handle.join() {
+                std::panic::resume_unwind(payload);
+            }
+        }
+    });
+    for buffer in outputs {
+        out.write_all(&buffer.into_inner().unwrap())
+            .expect("Something went wrong writing output");
+    }
+}
+
+fn int_pow(l: i64, r: i64) -> Value {
+    if r < 0 {
+        return Value::Float((l as f64).powf(r as f64));
+    }
+    match u32::try_from(r) {
+        Ok(exp) => Value::Number(l.checked_pow(exp).expect("Integer overflow in '**'")),
+        // an exponent past u32::MAX can only avoid overflowing from -1, 0 or 1
+        Err(_) => match l {
+            0 => Value::Number(0),
+            1 => Value::Number(1),
+            -1 => Value::Number(if r % 2 == 0 { 1 } else { -1 }),
+            _ => panic!("Integer overflow in '**'"),
+        },
+    }
+}
+
+// the integer and float arms of binary_op, split out so the quickened
+// instructions can reach them with the primitives already in hand
+fn number_op(l: i64, op: &Token, r: i64) -> Value {
+    match op {
+        // checked arithmetic: overflow is a reported error instead of
+        // a silent wrap, and the result stays an integer
+        Token::Plus => Value::Number(l.checked_add(r).expect("Integer overflow in '+'")),
+        Token::Minus => Value::Number(l.checked_sub(r).expect("Integer overflow in '-'")),
+        Token::Multiply => Value::Number(l.checked_mul(r).expect("Integer overflow in '*'")),
+        Token::Divide => Value::Float(l as f64 / r as f64),
+        Token::Equal => Value::Boolean(l == r),
+        Token::NotEqual => Value::Boolean(l != r),
+        Token::Greater => Value::Boolean(l > r),
+        Token::Less => Value::Boolean(l < r),
+        Token::GreaterEqual => Value::Boolean(l >= r),
+        Token::FloorDivide => Value::Number(l / r),
+        Token::LessEqual => Value::Boolean(l <= r),
+        Token::Modulus => Value::Number(l % r),
+        Token::Power => int_pow(l, r),
+        _ => panic!("Unsupported operator for numbers"),
+    }
+}
+
+fn float_op(l: f64, op: &Token, r: f64) -> Value {
+    match op {
+        Token::Plus => Value::Float(l + r),
+        Token::Minus => Value::Float(l - r),
+        Token::Multiply => Value::Float(l * r),
+        Token::Divide => Value::Float(l / r),
+        Token::Equal => Value::Boolean(l == r),
+        Token::NotEqual => Value::Boolean(l != r),
+        Token::Greater => Value::Boolean(l > r),
+        Token::Modulus => Value::Float(l % r),
+        Token::FloorDivide => Value::Number((l / r).floor() as i64),
+        Token::Less => Value::Boolean(l < r),
+        Token::GreaterEqual => Value::Boolean(l >= r),
+        Token::LessEqual => Value::Boolean(l <= r),
+        Token::Power => Value::Float(l.powf(r)),
+        _ => panic!("Unsupported operator for floats"),
+    }
+}
+
+// one line off a buffered reader, without the trailing newline (and without
+// a carriage return, so crlf data files read cleanly); Null at end of input
+fn read_line_from(reader: &mut impl BufRead) -> Value {
+    let mut line = String::new();
+    match reader.read_line(&mut line) {
+        Ok(0) => Value::Null,
+        Ok(_) => {
+            if line.ends_with('\n') {
+                line.pop();
+                if line.ends_with('\r') {
+                    line.pop();
+                }
+            }
+            Value::String(Rc::new(line))
+        }
+        Err(e) => panic!("Error reading line: {}", e),
+    }
+}
+
+fn binary_op(left: Value, op: &Token, right: Value) -> Value {
+    match (left, right) {
+        (Value::Number(l), Value::Number(r)) => number_op(l, op, r),
+        (Value::Float(l), Value::Float(r)) => float_op(l, op, r),
+        (Value::Number(l), Value::Float(r)) => {
+            let l = l as f64;
+            match op {
+                Token::Plus => Value::Float(l + r),
+                Token::Minus => Value::Float(l - r),
+                Token::Multiply => Value::Float(l * r),
+                Token::Divide => Value::Float(l / r),
+                Token::Equal => Value::Boolean(l == r),
+                Token::Modulus => Value::Float(l % r),
+                Token::NotEqual => Value::Boolean(l != r),
+                Token::FloorDivide => Value::Number((l / r).floor() as i64),
+                Token::Greater => Value::Boolean(l > r),
+                Token::Less => Value::Boolean(l < r),
+                Token::GreaterEqual => Value::Boolean(l >= r),
+                Token::Power => Value::Float(l.powf(r)),
+                Token::LessEqual => Value::Boolean(l <= r),
+                _ => panic!("Unsupported operator for mixed number and float"),
+            }
+        }
+        (Value::Float(l), Value::Number(r)) => {
+            let r = r as f64;
+            match op {
+                Token::Plus => Value::Float(l + r),
+                Token::Minus => Value::Float(l - r),
+                Token::Multiply => Value::Float(l * r),
+                Token::Divide => Value::Float(l / r),
+                Token::Equal => Value::Boolean(l == r),
+                Token::Modulus => Value::Float(l % r),
+                Token::NotEqual => Value::Boolean(l != r),
+                Token::Greater => Value::Boolean(l > r),
+                Token::Less => Value::Boolean(l < r),
+                Token::GreaterEqual => Value::Boolean(l >= r),
+                Token::FloorDivide => Value::Number((l / r).floor() as i64),
+                Token::Power => Value::Float(l.powf(r)),
+                Token::LessEqual => Value::Boolean(l <= r),
+                _ => panic!("Unsupported operator for mixed float and number"),
+            }
+        }
+        (Value::String(s), Value::String(t)) => {
+            match op {
+                // append in place when we hold the only reference,
+                // otherwise copy once like the old interpreter did
+                Token::Plus => match Rc::try_unwrap(s) {
+                    Ok(mut owned) => {
+                        owned.push_str(&t);
+                        Value::String(Rc::new(owned))
+                    }
+                    Err(s) => Value::String(Rc::new((*s).clone() + &t)),
+                },
+                Token::Equal => Value::Boolean(s == t),
+                Token::NotEqual => Value::Boolean(s != t),
+                _ => panic!("Unsupported operator for strings"),
+            }
+        }
+        // repetition: str::repeat sizes its result buffer upfront, so
+        // building padding this way is one allocation instead of n
+        (Value::String(s), Value::Number(n)) | (Value::Number(n), Value::String(s))
+            if *op == Token::Multiply =>
+        {
+            if n < 0 {
+                panic!("String repetition count cannot be negative");
+            }
+            Value::String(Rc::new(s.repeat(n as usize)))
+        }
+        (Value::Boolean(b1), Value::Boolean(b2)) => {
+            match op {
+                Token::And => Value::Boolean(b1 && b2),
+                Token::Or => Value::Boolean(b1 || b2),
+                Token::Equal => Value::Boolean(b1 == b2),
+                Token::NotEqual => Value::Boolean(b1 != b2),
+                _ => panic!("Unsupported operator for booleans"),
+            }
+        }
+        (Value::Type(t1), Value::Type(t2)) => {
+            match op {
+                Token::Equal => Value::Boolean(t1 == t2),
+                Token::NotEqual => Value::Boolean(t1 != t2),
+                _ => panic!("Unsupported operator for types"),
+            }
+        }
+        (Value::Array(a1), Value::Array(a2)) => {
+            match op {
+                Token::Equal => Value::Boolean(arrays_equal(&a1, &a2)),
+                Token::NotEqual => Value::Boolean(!arrays_equal(&a1, &a2)),
+                _ => panic!("Unsupported operator for arrays"),
+            }
+        }
+        // null only supports identity tests, but against any type: that is
+        // what makes `while (line != null)` streaming loops work
+        (Value::Null, other) | (other, Value::Null)
+            if matches!(op, Token::Equal | Token::NotEqual) =>
+        {
+            let same = matches!(other, Value::Null);
+            Value::Boolean(if *op == Token::Equal { same } else { !same })
+        }
+        (_, _) if *op == Token::And => panic!("AND operator can only be applied to boolean values"),
+        (_, _) if *op == Token::Or => panic!("OR operator can only be applied to boolean values"),
+        _ => panic!("Unsupported operation for given types"),
+    }
+}
+
+// element-wise comparison; values of different kinds are simply unequal
+fn values_equal(left: &Value, right: &Value) -> bool {
+    match (left, right) {
+        (Value::Number(l), Value::Number(r)) => l == r,
+        (Value::Float(l), Value::Float(r)) => l == r,
+        (Value::String(l), Value::String(r)) => l == r,
+        (Value::Boolean(l), Value::Boolean(r)) => l == r,
+        (Value::Null, Value::Null) => true,
+        (Value::Type(l), Value::Type(r)) => l == r,
+        (Value::Array(l), Value::Array(r)) => arrays_equal(l, r),
+        _ => false,
+    }
+}
+
+fn arrays_equal(left: &Rc<RefCell<Vec<Value>>>, right: &Rc<RefCell<Vec<Value>>>) -> bool {
+    if Rc::ptr_eq(left, right) {
+        return true;
+    }
+    let (left, right) = (left.borrow(), right.borrow());
+    left.len() == right.len() && left.iter().zip(right.iter()).all(|(l, r)| values_equal(l, r))
+}
+
+// single-character results of string indexing come out of this per-run pool:
+// a loop over `s[i]` would otherwise allocate and free a one-char String per
+// iteration. the pool keeps one Rc per character alive, which also pins the
+// refcount so the in-place append fast path can never mutate a pooled string
+fn pooled_char(pool: &mut [Option<Rc<String>>], byte: u8) -> Rc<String> {
+    match &mut pool[byte as usize] {
+        Some(s) => s.clone(),
+        entry => {
+            let s = Rc::new((byte as char).to_string());
+            *entry = Some(s.clone());
+            s
+        }
+    }
+}
+
+// how a value looks inside a printed array; top-level scalars print directly.
+// formats into a caller-owned buffer that run_with_frame reuses across
+// prints, so one array print fills one buffer instead of building a String
+// per element and joining them
+fn display_into(buf: &mut String, value: &Value) {
+    use std::fmt::Write;
+    match value {
+        Value::Number(n) => {
+            let _ = write!(buf, "{}", n);
+        }
+        Value::String(s) => buf.push_str(s),
+        Value::Boolean(b) => {
+            let _ = write!(buf, "{}", b);
+        }
+        Value::Float(f) => {
+            let _ = write!(buf, "{}", f);
+        }
+        Value::Null => buf.push_str("null"),
+        Value::Type(t) => buf.push_str(t),
+        Value::Array(a) => {
+            buf.push('[');
+            for (index, element) in a.borrow().iter().enumerate() {
+                if index > 0 {
+                    buf.push_str(", ");
+                }
+                display_into(buf, element);
+            }
+            buf.push(']');
+        }
+    }
+}
+
+fn cast_value(type_name: &str, value: Value) -> Value {
+    match type_name {
+        "int" => match value {
+            Value::Number(n) => Value::Number(n),
+            Value::Float(f) => Value::Number(f as i64),
+            Value::String(s) => {
+                if s.chars().all(|c| c.is_digit(10)) {
+                    Value::Number(s.parse::<i64>().unwrap())
+                } else {
+                    panic!("Cannot convert string '{}' to int", s)
+                }
+            }
+            Value::Boolean(b) => Value::Number(if b { 1 } else { 0 }),
+            _ => panic!("Cannot convert to int"),
+        },
+        "str" => match value {
+            Value::Number(n) => Value::String(Rc::new(n.to_string())),
+            Value::Float(f) => Value::String(Rc::new(f.to_string())),
+            Value::String(s) => Value::String(s),
+            Value::Boolean(b) => Value::String(Rc::new(b.to_string())),
+            Value::Null => Value::String(Rc::new("null".to_string())),
+            _ => panic!("Cannot convert to string"),
+        },
+        "float" => match value {
+            Value::Number(n) => Value::Float(n as f64),
+            Value::Float(f) => Value::Float(f),
+            Value::String(s) => {
+                match s.parse::<f64>() {
+                    Ok(f) => Value::Float(f),
+                    Err(_) => panic!("Cannot convert string '{}' to float", s),
+                }
+            }
+            Value::Boolean(b) => Value::Float(if b { 1.0 } else { 0.0 }),
+            _ => panic!("Cannot convert to float"),
+        },
+        "bool" => match value {
+            Value::Number(n) => Value::Boolean(n != 0),
+            Value::Float(f) => Value::Boolean(f != 0.0),
+            Value::String(s) => Value::Boolean(!s.is_empty()),
+            Value::Boolean(b) => Value::Boolean(b),
+            Value::Null => Value::Boolean(false),
+            _ => panic!("Cannot convert to bool"),
+        },
+        _ => panic!("Unknown type cast: {}", type_name),
+    }
+}
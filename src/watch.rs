@@ -0,0 +1,88 @@
+use crate::{brainrot, cache, compiler, error, modules, optimizer, parser, vm};
+use std::collections::HashMap;
+use std::fs;
+use std::io::{self, Write};
+use std::path::{Path, PathBuf};
+use std::time::{Duration, Instant, SystemTime};
+
+// watch mode: keep the process alive and rerun the script whenever it or any
+// module it imports changes on disk. the front end is incremental by content
+// hash: every program compiled this session stays in memory keyed by its
+// linked-source hash, so only genuinely new source pays for lexing, parsing
+// and compilation - a save that doesn't change the bytes, or an edit that
+// reverts to an earlier version, goes straight to execution in the warm
+// process. each run gets a fresh frame, and an error is reported like any
+// other run instead of taking the watcher down.
+pub fn run(filename: &str, is_verbose: bool, no_opt: bool) {
+    let mut chunks: HashMap<u64, compiler::Chunk> = HashMap::new();
+    let mut watched: Vec<PathBuf> = Vec::new();
+    let mut last_hash: Option<u64> = None;
+
+    eprintln!("watch: {} (ctrl-c to stop)", filename);
+    loop {
+        let started = Instant::now();
+        let mut ran_hash = None;
+        let outcome = error::catch(|| {
+            let contents = fs::read_to_string(filename)
+                .expect("Something went wrong reading the file");
+            let processed_contents = if filename.ends_with(".br") {
+                brainrot::preprocess_skibidi(&contents)
+            } else {
+                contents
+            };
+            let (processed_contents, deps) =
+                modules::resolve_tracked(filename, processed_contents);
+            watched = deps;
+
+            let hash = cache::source_hash(&processed_contents);
+            if last_hash == Some(hash) {
+                // the save left the linked program byte-identical; no rerun
+                return false;
+            }
+            ran_hash = Some(hash);
+            if !chunks.contains_key(&hash) {
+                let mut parser = parser::Parser::new(&processed_contents);
+                let program = parser.parse();
+                let program = if no_opt { program } else { optimizer::optimize(program) };
+                chunks.insert(hash, compiler::compile(&program, parser.slots()));
+            }
+
+            let mut out = io::BufWriter::new(io::stdout().lock());
+            vm::run_with_frame(&chunks[&hash], &mut Vec::new(), &mut out, is_verbose, None);
+            out.flush().expect("Something went wrong writing output");
+            true
+        });
+        // a failed version is remembered too, so a touch that doesn't fix
+        // the file reports once instead of re-parsing the same broken source
+        if ran_hash.is_some() {
+            last_hash = ran_hash;
+        }
+        let millis = started.elapsed().as_secs_f64() * 1000.0;
+        match outcome {
+            Ok(true) => eprintln!("watch: ok ({:.1}ms)", millis),
+            Ok(false) => {}
+            Err(e) => eprintln!("watch: error: {}", e),
+        }
+
+        // poll for the next change across the entry and its module graph;
+        // a short settle pause lets editors finish multi-file write bursts
+        let stamps = mtimes(filename, &watched);
+        loop {
+            std::thread::sleep(Duration::from_millis(200));
+            if mtimes(filename, &watched) != stamps {
+                std::thread::sleep(Duration::from_millis(50));
+                break;
+            }
+        }
+    }
+}
+
+fn mtimes(entry: &str, deps: &[PathBuf]) -> Vec<Option<SystemTime>> {
+    let mut stamps = vec![stamp(Path::new(entry))];
+    stamps.extend(deps.iter().map(|path| stamp(path)));
+    stamps
+}
+
+fn stamp(path: &Path) -> Option<SystemTime> {
+    fs::metadata(path).ok().and_then(|meta| meta.modified().ok())
+}